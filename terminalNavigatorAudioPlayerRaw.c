@@ -24,6 +24,20 @@
 #include <strings.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <wctype.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/file.h>
+#include <stddef.h>
+#include <ctype.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 void draw_file_list(WINDOW *win);
 void draw_field_frame(WINDOW *win);
@@ -48,7 +62,15 @@ static void play_single_file(void);
 #define COLOR_PAIR_PROGRESS 8
 #define ERROR  1
 #define STATUS 2
-#define FADE_STEPS 48
+#define FADE_MS 1000
+#define FADE_FRAMES (RATE * FADE_MS / 1000)
+#define FADE_TABLE_BITS 10
+#define FADE_TABLE_SIZE (1 << FADE_TABLE_BITS)
+#define FADE_PHASE_STEP ((uint64_t)FADE_TABLE_SIZE * 4294967296ULL / FADE_FRAMES)
+#define FADE_LINEAR 0
+#define FADE_EQUAL_POWER 1
+#define FADE_EXPONENTIAL 2
+#define FADE_CURVES 3
 #define CHANNELS 2
 #define RATE 44100
 #define FRAME_SIZE (CHANNELS * 2)
@@ -63,13 +85,38 @@ static void play_single_file(void);
 #define SAFE_FREE_ARRAY(arr, count) SAFE_FREE_GENERIC((arr), free_names, (count), 0)
 #define SAFE_STRDUP(src) safe_strdup(src)
 #define SAFE_CALLOC(num, size) calloc((num), (size))
-#define SAFE_CLEANUP_RESOURCES(filep, handlep, pollfdsp, currfilep) safe_cleanup_resources((filep), (handlep), (pollfdsp), (currfilep))
+#define SAFE_CLEANUP_RESOURCES(filep, sinkp, currfilep) safe_cleanup_resources((filep), (sinkp), (currfilep))
 #define SAFE_STRNCPY(dest, src, size) do { strncpy((dest), (src), (size)); (dest)[(size)-1] = '\0'; } while (0)
 #define COLOR_ATTR_ON(win, attr) wattron(win, COLOR_PAIR(attr))
 #define COLOR_ATTR_OFF(win, attr) wattroff(win, COLOR_PAIR(attr))
 #define ACCESS_DENIED_MSG "Access denied to: %s"
 #define SAFE_MUTEX_LOCK(m) do { int ret = pthread_mutex_lock(m); if (ret != 0) { display_message(ERROR, "Mutex lock failed: %s", strerror(ret)); } } while (0)
-#define TOTAL_HELP_LINES 120
+#define WALK_MAX_THREADS 8
+#define WALK_DEQUE_INIT 64
+#define PREFETCH_AHEAD_BYTES (BYTES_PER_SECOND * 3)
+#define PREFETCH_SLOTS 2
+#define HOVER_READAHEAD_BYTES (BYTES_PER_SECOND / 1000 * 300)
+#define HOVER_MISS (-2)
+#define LISTING_CACHE_SLOTS 8
+#define LISTING_WORKERS 2
+#define LISTING_HOVER_DELAY_MS 120
+#define DEBUG_OVERLAY_LINES 13
+#define STATS_BUCKETS 24
+#define TRACE_RING_EVENTS 4096
+#define TRACE_MAX_THREADS 32
+#define STATUS_PAGE_MAGIC 0x52504154u
+#define STATUS_PAGE_VERSION 1
+#define STATUS_PATH_BYTES 4096
+#define STATUS_PUBLISH_MS 50
+#define METRICS_INTERVAL_MS 5000
+#define PREFETCH_READAHEAD_BYTES (BYTES_PER_SECOND * 4)
+#define CROSSFADE_MAX_MS 10000
+#define CROSSFADE_STEP_MS 1000
+#define PAUSE_FADE_FRAMES 512
+#define PAUSE_TAIL_FRAMES 1024
+#define OUTPUT_RUNNING 0
+#define OUTPUT_HW_PAUSED 1
+#define OUTPUT_STOPPED 2
 
 typedef struct PlayerControl PlayerControl;
 void action_s(PlayerControl *control);
@@ -290,6 +337,7 @@ SAFE_FREE(wsrc);
 typedef struct {
     char *name;
     int is_dir;
+    int marked;
 } FileEntry;
 static char *safe_strdup(const char *src);
 static void display_message(int type, const char *fmt, ...);
@@ -300,6 +348,7 @@ static void check_alloc(void *ptr) {if (!ptr) memory_error();}
 static int is_raw_file(const char *name);
 __attribute__((unused)) static char *xasprintf(const char *fmt, ...);
 static void free_names(void *entries, int count, int is_file_entry);
+static int listing_take(const char *dir_path, FileEntry **entries_out, int *count_out);
 static inline int should_skip_entry(const struct dirent *entry, int filter_raw) {
     return (entry->d_name[0] == '.') || (filter_raw && !is_raw_file(entry->d_name));
 }
@@ -361,6 +410,7 @@ static int scan_directory(const char *dir_path, int filter_raw, void **entries_o
                 ((FileEntry *)entries)[idx].is_dir = S_ISDIR(st.st_mode) ? 1 : 0;
             }
             ((FileEntry *)entries)[idx].name = name;
+            ((FileEntry *)entries)[idx].marked = 0;
             free(full_path);
         }
         idx++;
@@ -416,6 +466,7 @@ COLOR_ATTR_OFF(win, COLOR_PAIR_PROGRESS | A_BOLD);
 }
 static char *next_file_to_play = NULL;
 static char *next_file_name_to_play = NULL;
+static FILE *next_file_handoff = NULL;
 static char status_msg[256] = "";
 static int show_status = 0;
 static time_t status_start_time = 0;
@@ -435,9 +486,12 @@ char root_dir[PATH_MAX] = {0};
 int path_visual_offset = 0;
 WINDOW *list_win = NULL;
 int term_height, term_width;
+static int debug_overlay = 0;
+static void draw_debug_overlay(WINDOW *win);
 static inline void refresh_ui(void)
 {
     draw_file_list(list_win);
+    if (debug_overlay) draw_debug_overlay(list_win);
     wnoutrefresh(stdscr);
     wnoutrefresh(list_win);
     doupdate();
@@ -475,6 +529,8 @@ static void free_names(void *entries, int count, int is_file_entry) {
     free(entries);
 }
 
+static void init_color_pairs(void);
+
 void init_ncurses(const char *locale) {
     if (setlocale(LC_ALL, locale) == NULL) {
         fprintf(stderr, "Failed to set locale: %s — fallback to default\n", locale);
@@ -490,8 +546,12 @@ void init_ncurses(const char *locale) {
     initscr();
     cbreak();
     noecho();
-    use_default_colors();
     keypad(stdscr, TRUE);
+    init_color_pairs();
+}
+
+static void init_color_pairs(void) {
+    use_default_colors();
     if (has_colors()) {
         start_color();
         init_pair(COLOR_PAIR_BORDER, COLOR_GREEN, COLOR_BLACK);
@@ -505,6 +565,183 @@ void init_ncurses(const char *locale) {
     }
 }
 
+typedef struct LatencyHistogram {
+    const char *name;
+    atomic_ulong count;
+    atomic_ulong total_us;
+    atomic_ulong max_us;
+    atomic_ulong buckets[STATS_BUCKETS];
+} LatencyHistogram;
+
+typedef struct AudioStats {
+    atomic_ulong xruns;
+    atomic_ulong eagain_waits;
+    atomic_ulong write_errors;
+    LatencyHistogram write;
+    LatencyHistogram wakeup_jitter;
+    LatencyHistogram read;
+    LatencyHistogram fill;
+} AudioStats;
+
+static AudioStats audio_stats = {
+    .write = {.name = "write"},
+    .wakeup_jitter = {.name = "wakeup_jitter"},
+    .read = {.name = "read"},
+    .fill = {.name = "fill"},
+};
+
+static uint64_t monotonic_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+}
+
+static void histogram_record(LatencyHistogram *h, unsigned long us) {
+    int bucket = us ? 64 - __builtin_clzll(us) : 0;
+    if (bucket >= STATS_BUCKETS) bucket = STATS_BUCKETS - 1;
+    atomic_fetch_add_explicit(&h->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->total_us, us, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    if (us > atomic_load_explicit(&h->max_us, memory_order_relaxed))
+        atomic_store_explicit(&h->max_us, us, memory_order_relaxed);
+}
+
+static unsigned long histogram_percentile(LatencyHistogram *h, double fraction) {
+    unsigned long count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    unsigned long max_us = atomic_load_explicit(&h->max_us, memory_order_relaxed);
+    double target = count * fraction;
+    unsigned long seen = 0;
+    for (int i = 0; count > 0 && i < STATS_BUCKETS; i++) {
+        unsigned long in_bucket = atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if (in_bucket == 0 || seen + in_bucket < target) {
+            seen += in_bucket;
+            continue;
+        }
+        if (i == 0) return 0;
+        double lower = (double)(1ul << (i - 1));
+        double upper = i == STATS_BUCKETS - 1 ? (double)max_us : (double)((1ul << i) - 1);
+        if (upper > max_us) upper = max_us;
+        if (upper < lower) upper = lower;
+        return (unsigned long)(lower + (upper - lower) * (target - seen) / in_bucket + 0.5);
+    }
+    return max_us;
+}
+
+static int histogram_format(LatencyHistogram *h, char *out, size_t size) {
+    unsigned long count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    return snprintf(out, size, "stats=%s count=%lu mean_us=%lu p50_us=%lu p99_us=%lu max_us=%lu", h->name, count,
+                    count ? atomic_load_explicit(&h->total_us, memory_order_relaxed) / count : 0,
+                    histogram_percentile(h, 0.5), histogram_percentile(h, 0.99),
+                    atomic_load_explicit(&h->max_us, memory_order_relaxed));
+}
+
+static void audio_stats_dump(FILE *out) {
+    if (atomic_load_explicit(&audio_stats.write.count, memory_order_relaxed) == 0) return;
+    LatencyHistogram *histograms[] = {&audio_stats.write, &audio_stats.wakeup_jitter, &audio_stats.read, &audio_stats.fill};
+    char line[160];
+    fprintf(out, "stats=xrun count=%lu eagain_waits=%lu write_errors=%lu\n", atomic_load(&audio_stats.xruns),
+            atomic_load(&audio_stats.eagain_waits), atomic_load(&audio_stats.write_errors));
+    for (size_t i = 0; i < sizeof(histograms) / sizeof(histograms[0]); i++) {
+        histogram_format(histograms[i], line, sizeof(line));
+        fprintf(out, "%s\n", line);
+    }
+}
+
+typedef struct TraceEvent {
+    uint64_t ts_ns;
+    const char *name;
+    long arg;
+    char phase;
+} TraceEvent;
+
+typedef struct TraceRing {
+    pid_t tid;
+    char thread_name[16];
+    atomic_ulong head;
+    TraceEvent events[TRACE_RING_EVENTS];
+} TraceRing;
+
+static TraceRing *trace_rings[TRACE_MAX_THREADS];
+static atomic_int trace_ring_count;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread TraceRing *trace_ring;
+static __thread int trace_ring_failed;
+static volatile sig_atomic_t trace_dump_requested = 0;
+
+static TraceRing *trace_ring_register(void) {
+    pthread_mutex_lock(&trace_lock);
+    int count = atomic_load(&trace_ring_count);
+    TraceRing *ring = count < TRACE_MAX_THREADS ? calloc(1, sizeof(TraceRing)) : NULL;
+    if (ring) {
+        ring->tid = gettid();
+        pthread_getname_np(pthread_self(), ring->thread_name, sizeof(ring->thread_name));
+        trace_rings[count] = ring;
+        atomic_store(&trace_ring_count, count + 1);
+    }
+    pthread_mutex_unlock(&trace_lock);
+    return ring;
+}
+
+static void trace_event(const char *name, char phase, long arg) {
+    TraceRing *ring = trace_ring;
+    if (!ring) {
+        if (trace_ring_failed) return;
+        ring = trace_ring = trace_ring_register();
+        if (!ring) {
+            trace_ring_failed = 1;
+            return;
+        }
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    TraceEvent *event = &ring->events[head & (TRACE_RING_EVENTS - 1)];
+    event->ts_ns = (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+    event->name = name;
+    event->arg = arg;
+    event->phase = phase;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static void trace_request_dump(int sig) {
+    (void)sig;
+    trace_dump_requested = 1;
+}
+
+static int trace_dump(char *path, size_t path_size) {
+    const char *dir = getenv("TMPDIR");
+    int pid = (int)getpid();
+    snprintf(path, path_size, "%s/tapraw-trace-%d-%ld.json", dir && *dir ? dir : "/tmp", pid, (long)time(NULL));
+    FILE *out = fopen(path, "w");
+    if (!out) return -1;
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    int count = atomic_load(&trace_ring_count);
+    for (int r = 0; r < count; r++) {
+        TraceRing *ring = trace_rings[r];
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                r ? ",\n" : "", pid, (int)ring->tid, ring->thread_name);
+        unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (unsigned long i = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0; i < head; i++) {
+            TraceEvent event = ring->events[i & (TRACE_RING_EVENTS - 1)];
+            if (atomic_load_explicit(&ring->head, memory_order_acquire) - i >= TRACE_RING_EVENTS) continue;
+            fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d", event.name, event.phase,
+                    event.ts_ns / 1000.0, pid, (int)ring->tid);
+            if (event.phase == 'i') fprintf(out, ",\"s\":\"t\"");
+            if (event.phase != 'E') fprintf(out, ",\"args\":{\"value\":%ld}", event.arg);
+            fputc('}', out);
+        }
+    }
+    fprintf(out, "\n]}\n");
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+static void trace_dump_report(void) {
+    char path[PATH_MAX];
+    trace_dump_requested = 0;
+    if (trace_dump(path, sizeof(path)) == 0) display_message(STATUS, "Trace written to %s", path);
+    else display_message(ERROR, "Cannot write trace %s: %s", path, strerror(errno));
+}
+
 static int setup_alsa_hw_params(snd_pcm_t *handle, snd_pcm_hw_params_t *params, unsigned int *rate, int channels, snd_pcm_uframes_t *period_size, snd_pcm_uframes_t *buffer_size);
 void play_audio(snd_pcm_t *handle, char *buffer, int size) {
     if (!handle || !buffer || size <= 0) {
@@ -518,15 +755,20 @@ display_message(ERROR, "Invalid params in play_audio");
         snd_pcm_sframes_t written = snd_pcm_writei(handle, ptr, remaining);
     if (written < 0) {
 if (written == (snd_pcm_sframes_t)-EAGAIN) {
+            atomic_fetch_add_explicit(&audio_stats.eagain_waits, 1, memory_order_relaxed);
+            snd_pcm_wait(handle, 100);
             continue;
         }
         if (written == -EPIPE) {
+            atomic_fetch_add_explicit(&audio_stats.xruns, 1, memory_order_relaxed);
+            trace_event("xrun", 'i', 0);
             if (snd_pcm_prepare(handle) < 0) {
                 display_message(ERROR, "snd_pcm_prepare failed after EPIPE");
                 snd_pcm_drop(handle);
                 return;
             }
         } else {
+            atomic_fetch_add_explicit(&audio_stats.write_errors, 1, memory_order_relaxed);
             display_message(ERROR, "snd_pcm_writei failed: %s", snd_strerror(written));
             snd_pcm_drop(handle);
             return;
@@ -557,16 +799,12 @@ if (!file) {
     return file;
 }
 
-static void safe_cleanup_resources(FILE **file, snd_pcm_t **handle, struct pollfd **poll_fds, char **current_filename) {
+typedef struct OutputSink OutputSink;
+static void sink_close(OutputSink **sink);
+
+static void safe_cleanup_resources(FILE **file, OutputSink **sink, char **current_filename) {
     if (file && *file) { fclose(*file); *file = NULL; }
-    if (handle && *handle) {
-if (*handle) {
-    snd_pcm_drop(*handle);
-    snd_pcm_close(*handle);
-    *handle = NULL;
-}
-    }
-    if (poll_fds && *poll_fds) { free(*poll_fds); *poll_fds = NULL; }
+    if (sink && *sink) sink_close(sink);
     if (current_filename && *current_filename) { free(*current_filename); *current_filename = NULL; }
 }
 
@@ -619,9 +857,9 @@ static int setup_alsa_hw_params(snd_pcm_t *handle, snd_pcm_hw_params_t *params,
     }
     return 0;
 }
-snd_pcm_t* init_audio_device(unsigned int rate, int channels) {
+snd_pcm_t* init_audio_device(const char *device, unsigned int rate, int channels) {
     snd_pcm_t *handle = NULL;
-    int ret = snd_pcm_open(&handle, "default", SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
+    int ret = snd_pcm_open(&handle, device, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
     if (handle_alsa_error(ret, "ALSA device open error", 1) < 0) {
         return NULL;
     }
@@ -642,6 +880,408 @@ snd_pcm_t* init_audio_device(unsigned int rate, int channels) {
     return handle;
 }
 
+#define NULL_SINK_BUFFER_FRAMES 4096
+#define DAEMON_MAX_CLIENTS 32
+#define DAEMON_LINE_MAX 4096
+
+typedef struct SinkOps {
+    const char *name;
+    int (*open)(OutputSink *sink, const char *arg);
+    int (*write)(OutputSink *sink, const char *buffer, int frames);
+    long (*delay)(OutputSink *sink);
+    int (*pause)(OutputSink *sink, int enable);
+    void (*drop)(OutputSink *sink);
+    int (*wait)(OutputSink *sink, int timeout_ms);
+    long (*rewind)(OutputSink *sink);
+    void (*close)(OutputSink *sink);
+} SinkOps;
+
+struct OutputSink {
+    const SinkOps *ops;
+    snd_pcm_t *pcm;
+    struct pollfd *poll_fds;
+    unsigned int poll_count;
+    int can_pause;
+    FILE *stream;
+    int is_pipe;
+    int wav;
+    int realtime;
+    int clocked;
+    int paused;
+    long long frames;
+    struct timespec epoch;
+    struct timespec paused_at;
+};
+
+static const char *sink_spec = NULL;
+static const char *render_output = NULL;
+
+static int alsa_sink_open(OutputSink *sink, const char *arg) {
+    sink->pcm = init_audio_device(arg ? arg : "default", RATE, CHANNELS);
+    if (!sink->pcm) return -1;
+    int count = snd_pcm_poll_descriptors_count(sink->pcm);
+    if (count > 0) {
+        sink->poll_fds = malloc(count * sizeof(struct pollfd));
+        if (sink->poll_fds) {
+            snd_pcm_poll_descriptors(sink->pcm, sink->poll_fds, count);
+            sink->poll_count = count;
+        }
+    }
+    snd_pcm_hw_params_t *params;
+    snd_pcm_hw_params_alloca(&params);
+    sink->can_pause = snd_pcm_hw_params_current(sink->pcm, params) == 0 && snd_pcm_hw_params_can_pause(params);
+    sink->clocked = 1;
+    return 0;
+}
+
+static int alsa_sink_write(OutputSink *sink, const char *buffer, int frames) {
+    snd_pcm_state_t state = snd_pcm_state(sink->pcm);
+    if (state != SND_PCM_STATE_PREPARED && state != SND_PCM_STATE_RUNNING) snd_pcm_prepare(sink->pcm);
+    play_audio(sink->pcm, (char *)buffer, frames * FRAME_SIZE);
+    return 0;
+}
+
+static long alsa_sink_delay(OutputSink *sink) {
+    snd_pcm_sframes_t delay = 0;
+    if (snd_pcm_delay(sink->pcm, &delay) != 0 || delay < 0) return 0;
+    return (long)delay;
+}
+
+static int alsa_sink_pause(OutputSink *sink, int enable) {
+    if (!sink->can_pause) return -1;
+    return snd_pcm_pause(sink->pcm, enable);
+}
+
+static void alsa_sink_drop(OutputSink *sink) {
+    snd_pcm_drop(sink->pcm);
+}
+
+static int alsa_sink_wait(OutputSink *sink, int timeout_ms) {
+    if (!sink->poll_fds) return 1;
+    if (poll(sink->poll_fds, sink->poll_count, timeout_ms) < 0) return 0;
+    unsigned short revents = 0;
+    snd_pcm_poll_descriptors_revents(sink->pcm, sink->poll_fds, sink->poll_count, &revents);
+    return (revents & POLLOUT) != 0;
+}
+
+static long alsa_sink_rewind(OutputSink *sink) {
+    snd_pcm_sframes_t rewindable = snd_pcm_rewindable(sink->pcm);
+    if (rewindable <= 0) return 0;
+    snd_pcm_sframes_t rewound = snd_pcm_rewind(sink->pcm, rewindable);
+    return rewound > 0 ? (long)rewound : 0;
+}
+
+static void alsa_sink_close(OutputSink *sink) {
+    snd_pcm_drop(sink->pcm);
+    snd_pcm_close(sink->pcm);
+    SAFE_FREE(sink->poll_fds);
+}
+
+static const SinkOps alsa_sink_ops = {
+    "alsa", alsa_sink_open, alsa_sink_write, alsa_sink_delay, alsa_sink_pause,
+    alsa_sink_drop, alsa_sink_wait, alsa_sink_rewind, alsa_sink_close,
+};
+
+static long long null_sink_played(OutputSink *sink) {
+    struct timespec now = sink->paused_at;
+    if (!sink->paused) clock_gettime(CLOCK_MONOTONIC, &now);
+    long long ns = (now.tv_sec - sink->epoch.tv_sec) * 1000000000LL + (now.tv_nsec - sink->epoch.tv_nsec);
+    return ns * RATE / 1000000000LL;
+}
+
+static void null_sink_sleep_frames(long long frames) {
+    if (frames <= 0) return;
+    long long ns = frames * 1000000000LL / RATE;
+    struct timespec ts = {ns / 1000000000LL, ns % 1000000000LL};
+    nanosleep(&ts, NULL);
+}
+
+static int null_sink_open(OutputSink *sink, const char *arg) {
+    if (arg && strcmp(arg, "fast") != 0) {
+        display_message(ERROR, "Unknown null sink mode: %s", arg);
+        return -1;
+    }
+    sink->realtime = !arg;
+    sink->clocked = sink->realtime;
+    clock_gettime(CLOCK_MONOTONIC, &sink->epoch);
+    return 0;
+}
+
+static int null_sink_write(OutputSink *sink, const char *buffer, int frames) {
+    (void)buffer;
+    if (!sink->realtime) return 0;
+    long long played = null_sink_played(sink);
+    if (played > sink->frames) {
+        clock_gettime(CLOCK_MONOTONIC, &sink->epoch);
+        sink->frames = 0;
+        played = 0;
+    }
+    sink->frames += frames;
+    null_sink_sleep_frames(sink->frames - played - NULL_SINK_BUFFER_FRAMES);
+    return 0;
+}
+
+static long null_sink_delay(OutputSink *sink) {
+    if (!sink->realtime) return 0;
+    long long queued = sink->frames - null_sink_played(sink);
+    return queued > 0 ? (long)queued : 0;
+}
+
+static int null_sink_pause(OutputSink *sink, int enable) {
+    if (enable == sink->paused) return 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (enable) {
+        sink->paused_at = now;
+    } else {
+        long long ns = sink->epoch.tv_nsec + (now.tv_sec - sink->paused_at.tv_sec) * 1000000000LL
+                       + (now.tv_nsec - sink->paused_at.tv_nsec);
+        sink->epoch.tv_sec += ns / 1000000000LL;
+        sink->epoch.tv_nsec = ns % 1000000000LL;
+    }
+    sink->paused = enable;
+    return 0;
+}
+
+static void null_sink_drop(OutputSink *sink) {
+    sink->frames = 0;
+    sink->paused = 0;
+    clock_gettime(CLOCK_MONOTONIC, &sink->epoch);
+}
+
+static int null_sink_wait(OutputSink *sink, int timeout_ms) {
+    long long room = NULL_SINK_BUFFER_FRAMES - null_sink_delay(sink);
+    if (room > 0) return 1;
+    long long wait = -room + 1;
+    if (wait > (long long)timeout_ms * RATE / 1000) wait = (long long)timeout_ms * RATE / 1000;
+    null_sink_sleep_frames(wait);
+    return null_sink_delay(sink) < NULL_SINK_BUFFER_FRAMES;
+}
+
+static void null_sink_close(OutputSink *sink) {
+    (void)sink;
+}
+
+static const SinkOps null_sink_ops = {
+    "null", null_sink_open, null_sink_write, null_sink_delay, null_sink_pause,
+    null_sink_drop, null_sink_wait, NULL, null_sink_close,
+};
+
+static void wav_header(unsigned char *h, uint32_t data_bytes) {
+    uint32_t v[] = {36 + data_bytes, 16, RATE, RATE * FRAME_SIZE, data_bytes};
+    memcpy(h, "RIFF", 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    memcpy(h + 36, "data", 4);
+    for (int i = 0; i < 4; i++) {
+        h[4 + i] = (unsigned char)(v[0] >> (8 * i));
+        h[16 + i] = (unsigned char)(v[1] >> (8 * i));
+        h[24 + i] = (unsigned char)(v[2] >> (8 * i));
+        h[28 + i] = (unsigned char)(v[3] >> (8 * i));
+        h[40 + i] = (unsigned char)(v[4] >> (8 * i));
+    }
+    h[20] = 1; h[21] = 0;
+    h[22] = CHANNELS; h[23] = 0;
+    h[32] = FRAME_SIZE; h[33] = 0;
+    h[34] = 16; h[35] = 0;
+}
+
+static int file_sink_open(OutputSink *sink, const char *arg) {
+    if (!arg || !*arg) {
+        display_message(ERROR, "File sink needs a path: file:PATH");
+        return -1;
+    }
+    sink->stream = fopen(arg, "wb");
+    if (!sink->stream) {
+        display_message(ERROR, "Cannot open output file %s: %s", arg, strerror(errno));
+        return -1;
+    }
+    size_t len = strlen(arg);
+    sink->wav = len > 4 && strcasecmp(arg + len - 4, ".wav") == 0;
+    if (sink->wav) {
+        unsigned char header[44] = {0};
+        wav_header(header, 0);
+        fwrite(header, 1, sizeof(header), sink->stream);
+    }
+    return 0;
+}
+
+static int stdout_sink_open(OutputSink *sink, const char *arg) {
+    if (arg) {
+        display_message(ERROR, "Stdout sink takes no argument: stdout");
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    sink->stream = stdout;
+    return 0;
+}
+
+static int pipe_sink_open(OutputSink *sink, const char *arg) {
+    if (!arg || !*arg) {
+        display_message(ERROR, "Pipe sink needs a command: pipe:COMMAND");
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    sink->stream = popen(arg, "w");
+    if (!sink->stream) {
+        display_message(ERROR, "Cannot start output command %s: %s", arg, strerror(errno));
+        return -1;
+    }
+    sink->is_pipe = 1;
+    return 0;
+}
+
+static int stream_sink_write(OutputSink *sink, const char *buffer, int frames) {
+    if (fwrite(buffer, FRAME_SIZE, frames, sink->stream) != (size_t)frames) return -1;
+    sink->frames += frames;
+    if (sink->stream == stdout || sink->is_pipe) fflush(sink->stream);
+    return 0;
+}
+
+static long stream_sink_delay(OutputSink *sink) {
+    (void)sink;
+    return 0;
+}
+
+static int stream_sink_pause(OutputSink *sink, int enable) {
+    (void)sink;
+    (void)enable;
+    return 0;
+}
+
+static void stream_sink_drop(OutputSink *sink) {
+    (void)sink;
+}
+
+static int stream_sink_wait(OutputSink *sink, int timeout_ms) {
+    (void)sink;
+    (void)timeout_ms;
+    return 1;
+}
+
+static void stream_sink_close(OutputSink *sink) {
+    if (sink->wav) {
+        unsigned char header[44] = {0};
+        wav_header(header, (uint32_t)(sink->frames * FRAME_SIZE));
+        if (fseek(sink->stream, 0, SEEK_SET) == 0) fwrite(header, 1, sizeof(header), sink->stream);
+    }
+    if (sink->is_pipe) pclose(sink->stream);
+    else if (sink->stream == stdout) fflush(stdout);
+    else fclose(sink->stream);
+}
+
+static const SinkOps file_sink_ops = {
+    "file", file_sink_open, stream_sink_write, stream_sink_delay, stream_sink_pause,
+    stream_sink_drop, stream_sink_wait, NULL, stream_sink_close,
+};
+
+static const SinkOps pipe_sink_ops = {
+    "pipe", pipe_sink_open, stream_sink_write, stream_sink_delay, stream_sink_pause,
+    stream_sink_drop, stream_sink_wait, NULL, stream_sink_close,
+};
+
+static const SinkOps stdout_sink_ops = {
+    "stdout", stdout_sink_open, stream_sink_write, stream_sink_delay, stream_sink_pause,
+    stream_sink_drop, stream_sink_wait, NULL, stream_sink_close,
+};
+
+static const SinkOps *sink_lookup(const char *spec, const char **arg) {
+    static const struct { const char *name; const SinkOps *ops; } types[] = {
+        {"alsa", &alsa_sink_ops}, {"null", &null_sink_ops}, {"file", &file_sink_ops},
+        {"pipe", &pipe_sink_ops}, {"stdout", &stdout_sink_ops},
+    };
+    *arg = NULL;
+    if (!spec || !*spec) return &alsa_sink_ops;
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        size_t len = strlen(types[i].name);
+        if (strncmp(spec, types[i].name, len) != 0) continue;
+        if (spec[len] == '\0') return types[i].ops;
+        if (spec[len] == ':') {
+            *arg = spec + len + 1;
+            return types[i].ops;
+        }
+    }
+    return NULL;
+}
+
+static OutputSink *sink_open(const char *spec) {
+    const char *arg;
+    const SinkOps *ops = sink_lookup(spec, &arg);
+    if (!ops) {
+        display_message(ERROR, "Unknown output sink: %s", spec);
+        return NULL;
+    }
+    OutputSink *sink = SAFE_CALLOC(1, sizeof(OutputSink));
+    SAFE_RETURN_IF_NULL(sink, NULL);
+    sink->ops = ops;
+    if (ops->open(sink, arg) != 0) {
+        free(sink);
+        return NULL;
+    }
+    return sink;
+}
+
+static void sink_close(OutputSink **sink) {
+    if (!*sink) return;
+    (*sink)->ops->close(*sink);
+    free(*sink);
+    *sink = NULL;
+}
+
+typedef struct AudioWarmup {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int started;
+    int done;
+    int taken;
+    OutputSink *sink;
+    double open_ms;
+} AudioWarmup;
+
+static AudioWarmup audio_warmup = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void *audio_warmup_thread(void *arg) {
+    (void)arg;
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    OutputSink *sink = sink_open(sink_spec);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_mutex_lock(&audio_warmup.lock);
+    audio_warmup.sink = sink;
+    audio_warmup.open_ms = (end.tv_sec - begin.tv_sec) * 1000.0 + (end.tv_nsec - begin.tv_nsec) / 1e6;
+    audio_warmup.done = 1;
+    pthread_cond_broadcast(&audio_warmup.cond);
+    pthread_mutex_unlock(&audio_warmup.lock);
+    return NULL;
+}
+
+static void audio_warmup_start(void) {
+    if (pthread_create(&audio_warmup.thread, NULL, audio_warmup_thread, NULL) == 0) {
+        audio_warmup.started = 1;
+    }
+}
+
+static OutputSink *audio_warmup_take(void) {
+    if (!audio_warmup.started) return NULL;
+    pthread_mutex_lock(&audio_warmup.lock);
+    while (!audio_warmup.done) pthread_cond_wait(&audio_warmup.cond, &audio_warmup.lock);
+    OutputSink *sink = audio_warmup.sink;
+    audio_warmup.sink = NULL;
+    if (sink) audio_warmup.taken = 1;
+    pthread_mutex_unlock(&audio_warmup.lock);
+    return sink;
+}
+
+static void audio_warmup_stop(void) {
+    if (!audio_warmup.started) return;
+    pthread_join(audio_warmup.thread, NULL);
+    audio_warmup.started = 0;
+    sink_close(&audio_warmup.sink);
+}
+
 static void draw_single_frame(WINDOW *win, int start_y, int height, const char *title, int line_type);
 static void draw_fill_line(WINDOW *win, int start_y, int start_x, int length, const void *symbol, int is_horizontal, int is_wide) {
 int y = start_y;
@@ -783,6 +1423,185 @@ int field_y = max_y - 3;
     doupdate();
 }
 
+typedef struct PlaylistTrack {
+    uint32_t dir;
+    uint32_t name;
+} PlaylistTrack;
+
+typedef struct Playlist {
+    int count;
+    int dir_count;
+    size_t bytes;
+    uint32_t *dirs;
+    PlaylistTrack *tracks;
+    uint32_t *order;
+    int shuffled;
+    char *pool;
+} Playlist;
+
+typedef struct PlaylistBuilder {
+    char *pool;
+    size_t pool_size;
+    size_t pool_capacity;
+    uint32_t *dirs;
+    int dir_count;
+    int dir_capacity;
+    PlaylistTrack *tracks;
+    int count;
+    int capacity;
+} PlaylistBuilder;
+
+static int playlist_pool_add(PlaylistBuilder *b, const char *str, size_t len, uint32_t *offset_out) {
+    if (b->pool_size + len + 1 > b->pool_capacity) {
+        size_t new_capacity = b->pool_capacity ? b->pool_capacity : 4096;
+        while (b->pool_size + len + 1 > new_capacity) new_capacity *= 2;
+        if (new_capacity > UINT32_MAX) return -1;
+        char *grown = realloc(b->pool, new_capacity);
+        if (!grown) return -1;
+        b->pool = grown;
+        b->pool_capacity = new_capacity;
+    }
+    memcpy(b->pool + b->pool_size, str, len);
+    b->pool[b->pool_size + len] = '\0';
+    *offset_out = (uint32_t)b->pool_size;
+    b->pool_size += len + 1;
+    return 0;
+}
+
+static int playlist_builder_add_dir_len(PlaylistBuilder *b, const char *dir, size_t len) {
+    if (b->dir_count > 0) {
+        const char *last = b->pool + b->dirs[b->dir_count - 1];
+        if (strlen(last) == len && memcmp(last, dir, len) == 0) return b->dir_count - 1;
+    }
+    if (b->dir_count >= b->dir_capacity) {
+        int new_capacity = b->dir_capacity ? b->dir_capacity * 2 : 16;
+        uint32_t *grown = realloc(b->dirs, new_capacity * sizeof(uint32_t));
+        if (!grown) return -1;
+        b->dirs = grown;
+        b->dir_capacity = new_capacity;
+    }
+    if (playlist_pool_add(b, dir, len, &b->dirs[b->dir_count]) != 0) return -1;
+    return b->dir_count++;
+}
+
+static int playlist_builder_add_dir(PlaylistBuilder *b, const char *dir) {
+    return playlist_builder_add_dir_len(b, dir, strlen(dir));
+}
+
+static int playlist_builder_add_track(PlaylistBuilder *b, int dir, const char *name) {
+    if (dir < 0) return -1;
+    if (b->count >= b->capacity) {
+        int new_capacity = b->capacity ? b->capacity * 2 : 64;
+        PlaylistTrack *grown = realloc(b->tracks, new_capacity * sizeof(PlaylistTrack));
+        if (!grown) return -1;
+        b->tracks = grown;
+        b->capacity = new_capacity;
+    }
+    PlaylistTrack *track = &b->tracks[b->count];
+    track->dir = (uint32_t)dir;
+    if (playlist_pool_add(b, name, strlen(name), &track->name) != 0) return -1;
+    b->count++;
+    return 0;
+}
+
+static int playlist_builder_add_path(PlaylistBuilder *b, const char *path) {
+    const char *slash = strrchr(path, '/');
+    if (!slash) return -1;
+    size_t dir_len = (slash == path) ? 1 : (size_t)(slash - path);
+    return playlist_builder_add_track(b, playlist_builder_add_dir_len(b, path, dir_len), slash + 1);
+}
+
+static void playlist_builder_free(PlaylistBuilder *b) {
+    SAFE_FREE(b->pool);
+    SAFE_FREE(b->dirs);
+    SAFE_FREE(b->tracks);
+    b->pool_size = b->pool_capacity = 0;
+    b->dir_count = b->dir_capacity = 0;
+    b->count = b->capacity = 0;
+}
+
+static Playlist *playlist_builder_finish(PlaylistBuilder *b) {
+    if (b->count == 0) {
+        playlist_builder_free(b);
+        return NULL;
+    }
+    size_t bytes = sizeof(Playlist) + b->count * sizeof(PlaylistTrack) +
+                   (b->dir_count + b->count) * sizeof(uint32_t) + b->pool_size;
+    Playlist *pl = malloc(bytes);
+    if (!pl) {
+        memory_error();
+        playlist_builder_free(b);
+        return NULL;
+    }
+    pl->count = b->count;
+    pl->dir_count = b->dir_count;
+    pl->bytes = bytes;
+    pl->tracks = (PlaylistTrack *)(pl + 1);
+    pl->dirs = (uint32_t *)(pl->tracks + b->count);
+    pl->order = pl->dirs + b->dir_count;
+    pl->shuffled = 0;
+    pl->pool = (char *)(pl->order + b->count);
+    for (int i = 0; i < b->count; i++) pl->order[i] = (uint32_t)i;
+    memcpy(pl->tracks, b->tracks, b->count * sizeof(PlaylistTrack));
+    memcpy(pl->dirs, b->dirs, b->dir_count * sizeof(uint32_t));
+    memcpy(pl->pool, b->pool, b->pool_size);
+    playlist_builder_free(b);
+    return pl;
+}
+
+static int playlist_track_path(const Playlist *pl, int index, char *buf, size_t size) {
+    const PlaylistTrack *track = &pl->tracks[index];
+    const char *dir = pl->pool + pl->dirs[track->dir];
+    int n = snprintf(buf, size, "%s/%s", strcmp(dir, "/") == 0 ? "" : dir, pl->pool + track->name);
+    return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
+
+static char *playlist_track_dup(const Playlist *pl, int index) {
+    char path[PATH_MAX];
+    if (!pl || index < 0 || index >= pl->count) return NULL;
+    if (playlist_track_path(pl, index, path, sizeof(path)) != 0) return NULL;
+    return safe_strdup(path);
+}
+
+static uint64_t shuffle_random(void) {
+    static uint64_t state = 0;
+    if (state == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        state = ((uint64_t)ts.tv_sec << 32) ^ (uint64_t)ts.tv_nsec ^ (uint64_t)getpid();
+        if (state == 0) state = 0x9E3779B97F4A7C15ULL;
+    }
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+static void playlist_shuffle(Playlist *pl, int pinned) {
+    if (!pl) return;
+    if (!pl->shuffled) {
+        for (int i = pl->count - 1; i > 0; i--) {
+            int j = (int)(shuffle_random() % (uint64_t)(i + 1));
+            uint32_t tmp = pl->order[i];
+            pl->order[i] = pl->order[j];
+            pl->order[j] = tmp;
+        }
+        pl->shuffled = 1;
+    }
+    if (pinned < 0) return;
+    for (int k = 0; k < pl->count; k++) {
+        if (pl->order[k] == (uint32_t)pinned) {
+            pl->order[k] = pl->order[0];
+            pl->order[0] = (uint32_t)pinned;
+            break;
+        }
+    }
+}
+
+static double playlist_bytes_per_track(const Playlist *pl) {
+    return (pl && pl->count > 0) ? (double)pl->bytes / pl->count : 0.0;
+}
+
 typedef struct PlayerControl {
     char *filename;
     int pause;
@@ -793,68 +1612,738 @@ typedef struct PlayerControl {
     FILE *current_file;
     char *current_filename;
     int paused;
-    char **playlist;
+    Playlist *playlist;
     int playlist_size;
-    int playlist_capacity;
     int current_track;
     int playlist_mode;
     int    seek_delta;
+    long long seek_target;
     double duration;
     long long bytes_read;
     int is_silent;
     int fading_out;
     int fading_in;
     int current_fade;
+    int fade_curve;
+    int crossfade_ms;
     char *playlist_dir;
     int loop_mode;
+    long long loop_a;
+    long long loop_b;
+    int loop_b_pending;
+    long delay_frames;
+    unsigned playlist_generation;
+    int playlist_loading;
+    int shuffle_mode;
+    int repeat_all;
+    int order_pos;
+    char **queue;
+    int queue_count;
+    int queue_capacity;
+    FILE *handoff_file;
+    char *handoff_path;
+    int fade_in_pending;
+    int fade_out_at_end;
+    long long end_fade_from;
+    int start_pending;
+    struct timespec start_requested;
+    double ttfs_last_ms;
+    double ttfs_total_ms;
+    unsigned long ttfs_count;
+    unsigned long track_starts;
+    unsigned long seeks_done;
+    unsigned long pauses_done;
+    unsigned long resumes_done;
+    int level_peak;
+    double level_rms;
 } PlayerControl;
 
-static void apply_fade(PlayerControl *ctrl, int fade_dir, char *buffer, int size) {
-    int16_t *samples = (int16_t *)buffer;
-    size_t num_samples = size / 2;
-    float factor_start = (float)ctrl->current_fade / FADE_STEPS;
-    float factor_end;
-    if (fade_dir < 0) {
-        factor_end = (float)(ctrl->current_fade - 1) / FADE_STEPS;
-        if (factor_end < 0) factor_end = 0.0f;
-    } else {
-        factor_end = (float)(ctrl->current_fade + 1) / FADE_STEPS;
-    }
-    for (size_t i = 0; i < num_samples; i++) {
-        float interp = (num_samples > 1) ? (float)i / (num_samples - 1) : 0.0f;
-        float factor = factor_start + (factor_end - factor_start) * interp;
-        samples[i] = (int16_t)(samples[i] * factor);
-    }
-    ctrl->current_fade += fade_dir;
-    if (fade_dir < 0 && ctrl->current_fade <= 0) {
-        ctrl->fading_out = 0;
-        ctrl->current_fade = 0;
-        ctrl->is_silent = 1;
-        if (!ctrl->paused) {
-            ctrl->stop = 1;
-        display_message(STATUS, "Fade completed, stopping");
+typedef struct PlayerStatus {
+    int32_t playing;
+    int32_t paused;
+    int64_t bytes_read;
+    double duration;
+    int32_t queue_count;
+    int32_t level_peak;
+    uint64_t track_starts;
+    int64_t delay_frames;
+    uint64_t xruns;
+    uint64_t updated_ns;
+    char path[STATUS_PATH_BYTES];
+} PlayerStatus;
+
+typedef struct StatusPage {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    atomic_uint seq;
+    PlayerStatus status;
+} StatusPage;
+
+static StatusPage status_page_local = {STATUS_PAGE_MAGIC, STATUS_PAGE_VERSION, sizeof(StatusPage), 0, {0}};
+static StatusPage *status_shared = NULL;
+static int status_shm_fd = -1;
+static char status_shm_name[NAME_MAX];
+
+static void status_write(StatusPage *page, const PlayerStatus *status) {
+    unsigned seq = atomic_load_explicit(&page->seq, memory_order_relaxed);
+    atomic_store_explicit(&page->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    if (strcmp(page->status.path, status->path) == 0) memcpy(&page->status, status, offsetof(PlayerStatus, path));
+    else page->status = *status;
+    atomic_store_explicit(&page->seq, seq + 2, memory_order_release);
+}
+
+static void status_publish(const PlayerControl *control) {
+    static PlayerStatus status;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t now_ns = (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+    int changed = status.playing != (control->current_filename != NULL) || status.paused != control->paused ||
+                  status.track_starts != control->track_starts || status.queue_count != control->queue_count;
+    if (!changed && now_ns - status.updated_ns < STATUS_PUBLISH_MS * 1000000ull) return;
+    status.playing = control->current_filename != NULL;
+    status.paused = control->paused;
+    status.bytes_read = control->bytes_read;
+    status.duration = control->duration;
+    status.queue_count = control->queue_count;
+    status.track_starts = control->track_starts;
+    status.level_peak = control->level_peak;
+    status.delay_frames = control->delay_frames;
+    status.xruns = atomic_load_explicit(&audio_stats.xruns, memory_order_relaxed);
+    status.updated_ns = now_ns;
+    const char *path = control->current_filename ? control->current_filename : "";
+    if (strcmp(status.path, path) != 0) SAFE_STRNCPY(status.path, path, sizeof(status.path));
+    status_write(&status_page_local, &status);
+    if (status_shared) status_write(status_shared, &status);
+}
+
+static void status_read(PlayerStatus *out) {
+    unsigned before, after;
+    do {
+        before = atomic_load_explicit(&status_page_local.seq, memory_order_acquire);
+        memcpy(out, &status_page_local.status, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&status_page_local.seq, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+}
+
+static int status_shm_claim(void) {
+    for (int attempt = 0; attempt < 3; attempt++) {
+        int fd = shm_open(status_shm_name, O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+        if (fd < 0) return -1;
+        struct stat st;
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            close(fd);
+            return -1;
         }
-    } else if (fade_dir > 0 && ctrl->current_fade >= FADE_STEPS) {
-        ctrl->fading_in = 0;
-        ctrl->current_fade = FADE_STEPS;
-        ctrl->is_silent = 0;
+        if (fstat(fd, &st) == 0 && st.st_nlink > 0) return fd;
+        close(fd);
     }
+    return -1;
 }
 
- void lock_and_signal(PlayerControl *control, void (*action)(PlayerControl *));
- void cleanup_playlist(PlayerControl *control) {
-    if (!control) return;
-    char **old_list = control->playlist;
-    int old_size = control->playlist_size;
-    char *old_dir = control->playlist_dir;
-    control->playlist = NULL;
-    control->playlist_size = 0;
-    control->playlist_capacity = 0;
-    control->current_track = 0;
-    control->playlist_dir = NULL;
-    if (old_list) {
-        free_names(old_list, old_size, 0);
+static void status_shm_open(void) {
+    const char *name = getenv("TAPRAW_SHM");
+    if (name && !*name) return;
+    if (name) SAFE_STRNCPY(status_shm_name, name, sizeof(status_shm_name));
+    else snprintf(status_shm_name, sizeof(status_shm_name), "/tapraw-%u", (unsigned)getuid());
+    int fd = status_shm_claim();
+    if (fd < 0) {
+        status_shm_name[0] = '\0';
+        return;
     }
+    StatusPage *page = MAP_FAILED;
+    if (ftruncate(fd, sizeof(StatusPage)) == 0)
+        page = mmap(NULL, sizeof(StatusPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (page == MAP_FAILED) {
+        shm_unlink(status_shm_name);
+        close(fd);
+        status_shm_name[0] = '\0';
+        return;
+    }
+    memset(page, 0, sizeof(*page));
+    page->magic = STATUS_PAGE_MAGIC;
+    page->version = STATUS_PAGE_VERSION;
+    page->size = sizeof(StatusPage);
+    status_shared = page;
+    status_shm_fd = fd;
+}
+
+static void status_shm_close(void) {
+    if (!status_shared) return;
+    munmap(status_shared, sizeof(StatusPage));
+    status_shared = NULL;
+    shm_unlink(status_shm_name);
+    close(status_shm_fd);
+    status_shm_fd = -1;
+}
+
+typedef struct MetricsExport {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    const char *path;
+    int interval_ms;
+    int started;
+    int quit;
+} MetricsExport;
+
+static MetricsExport metrics_export = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .interval_ms = METRICS_INTERVAL_MS,
+};
+
+static void quote_value(char *out, size_t size, const char *value) {
+    size_t n = 0;
+    out[n++] = '"';
+    for (const unsigned char *p = (const unsigned char *)value; *p && n + 6 < size; p++) {
+        if (*p == '"' || *p == '\\') {
+            out[n++] = '\\';
+            out[n++] = *p;
+        } else if (*p < 0x20) {
+            n += snprintf(out + n, size - n, "\\x%02x", *p);
+        } else {
+            out[n++] = *p;
+        }
+    }
+    out[n++] = '"';
+    out[n] = '\0';
+}
+
+static void metrics_label_value(char *out, size_t size, const char *value) {
+    size_t n = 0;
+    out[n++] = '"';
+    for (const unsigned char *p = (const unsigned char *)value; *p && n + 6 < size;) {
+        int len = *p < 0x80 ? 1 : (*p & 0xe0) == 0xc0 && *p >= 0xc2 ? 2 : (*p & 0xf0) == 0xe0 ? 3 : (*p & 0xf8) == 0xf0 && *p <= 0xf4 ? 4 : 0;
+        for (int i = 1; i < len; i++) {
+            if ((p[i] & 0xc0) != 0x80) len = 0;
+        }
+        if (*p == '"' || *p == '\\') {
+            out[n++] = '\\';
+            out[n++] = *p++;
+        } else if (*p == '\n') {
+            out[n++] = '\\';
+            out[n++] = 'n';
+            p++;
+        } else if (len == 0) {
+            memcpy(out + n, "\xef\xbf\xbd", 3);
+            n += 3;
+            p++;
+        } else {
+            memcpy(out + n, p, len);
+            n += len;
+            p += len;
+        }
+    }
+    out[n++] = '"';
+    out[n] = '\0';
+}
+
+static void metrics_histogram(FILE *out, LatencyHistogram *h, const char *metric, const char *help) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", metric, help, metric);
+    unsigned long cumulative = 0;
+    for (int i = 0; i < STATS_BUCKETS - 1; i++) {
+        cumulative += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        fprintf(out, "%s_bucket{le=\"%g\"} %lu\n", metric, (i ? (double)(1ul << i) : 0.0) / 1e6, cumulative);
+    }
+    unsigned long count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    fprintf(out, "%s_bucket{le=\"+Inf\"} %lu\n", metric, count);
+    fprintf(out, "%s_sum %g\n%s_count %lu\n", metric, atomic_load_explicit(&h->total_us, memory_order_relaxed) / 1e6, metric, count);
+}
+
+static int metrics_write(const char *path) {
+    PlayerStatus status;
+    status_read(&status);
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    FILE *out = fopen(tmp, "w");
+    if (!out) return -1;
+    fprintf(out, "# HELP tapraw_playing Whether a track is open for playback.\n# TYPE tapraw_playing gauge\ntapraw_playing %d\n", status.playing);
+    fprintf(out, "# HELP tapraw_paused Whether playback is paused.\n# TYPE tapraw_paused gauge\ntapraw_paused %d\n", status.paused);
+    fprintf(out, "# HELP tapraw_position_seconds Read position in the current track.\n# TYPE tapraw_position_seconds gauge\n");
+    fprintf(out, "tapraw_position_seconds %.3f\n", (double)status.bytes_read / BYTES_PER_SECOND);
+    fprintf(out, "# HELP tapraw_duration_seconds Length of the current track.\n# TYPE tapraw_duration_seconds gauge\n");
+    fprintf(out, "tapraw_duration_seconds %.3f\n", status.duration);
+    fprintf(out, "# HELP tapraw_queue_length Tracks waiting in the play queue.\n# TYPE tapraw_queue_length gauge\n");
+    fprintf(out, "tapraw_queue_length %d\n", status.queue_count);
+    fprintf(out, "# HELP tapraw_buffer_fill_seconds Audio queued in the output sink.\n# TYPE tapraw_buffer_fill_seconds gauge\n");
+    fprintf(out, "tapraw_buffer_fill_seconds %.6f\n", (double)status.delay_frames / RATE);
+    fprintf(out, "# HELP tapraw_tracks_started_total Tracks opened by the player.\n# TYPE tapraw_tracks_started_total counter\n");
+    fprintf(out, "tapraw_tracks_started_total %llu\n", (unsigned long long)status.track_starts);
+    fprintf(out, "# HELP tapraw_xruns_total Output underruns (EPIPE).\n# TYPE tapraw_xruns_total counter\n");
+    fprintf(out, "tapraw_xruns_total %lu\n", atomic_load(&audio_stats.xruns));
+    fprintf(out, "# HELP tapraw_eagain_waits_total Writes that found the device full.\n# TYPE tapraw_eagain_waits_total counter\n");
+    fprintf(out, "tapraw_eagain_waits_total %lu\n", atomic_load(&audio_stats.eagain_waits));
+    fprintf(out, "# HELP tapraw_write_errors_total Failed device writes.\n# TYPE tapraw_write_errors_total counter\n");
+    fprintf(out, "tapraw_write_errors_total %lu\n", atomic_load(&audio_stats.write_errors));
+    metrics_histogram(out, &audio_stats.write, "tapraw_sink_write_seconds", "Time spent in each sink write.");
+    metrics_histogram(out, &audio_stats.wakeup_jitter, "tapraw_wakeup_jitter_seconds", "Deviation of paced sink writes from the period deadline.");
+    metrics_histogram(out, &audio_stats.read, "tapraw_read_seconds", "Time spent in each file read.");
+    metrics_histogram(out, &audio_stats.fill, "tapraw_sink_fill_seconds", "Audio queued in the sink after each write.");
+    char quoted[STATUS_PATH_BYTES * 4 + 3];
+    metrics_label_value(quoted, sizeof(quoted), status.path);
+    fprintf(out, "# HELP tapraw_track_info Current track.\n# TYPE tapraw_track_info gauge\ntapraw_track_info{file=%s} %d\n",
+            quoted, status.playing);
+    if (fclose(out) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static void *metrics_thread(void *arg) {
+    (void)arg;
+    pthread_setname_np(pthread_self(), "tapraw-metrics");
+    pthread_mutex_lock(&metrics_export.lock);
+    while (!metrics_export.quit) {
+        pthread_mutex_unlock(&metrics_export.lock);
+        metrics_write(metrics_export.path);
+        pthread_mutex_lock(&metrics_export.lock);
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += metrics_export.interval_ms / 1000;
+        deadline.tv_nsec += (metrics_export.interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (!metrics_export.quit && pthread_cond_timedwait(&metrics_export.cond, &metrics_export.lock, &deadline) != ETIMEDOUT) {}
+    }
+    pthread_mutex_unlock(&metrics_export.lock);
+    metrics_write(metrics_export.path);
+    return NULL;
+}
+
+static void metrics_start(void) {
+    if (!metrics_export.path) return;
+    if (pthread_create(&metrics_export.thread, NULL, metrics_thread, NULL) == 0) metrics_export.started = 1;
+}
+
+static void metrics_stop(void) {
+    if (!metrics_export.started) return;
+    pthread_mutex_lock(&metrics_export.lock);
+    metrics_export.quit = 1;
+    pthread_cond_broadcast(&metrics_export.cond);
+    pthread_mutex_unlock(&metrics_export.lock);
+    pthread_join(metrics_export.thread, NULL);
+    metrics_export.started = 0;
+}
+
+static int playlist_next_track(PlayerControl *control, int *pos_out) {
+    Playlist *pl = control->playlist;
+    if (!pl || pl->count == 0) return -1;
+    int pos = (control->shuffle_mode ? control->order_pos : control->current_track) + 1;
+    if (pos >= pl->count) {
+        if (!control->repeat_all || control->playlist_loading) return -1;
+        pos = 0;
+    }
+    *pos_out = pos;
+    return control->shuffle_mode ? (int)pl->order[pos] : pos;
+}
+
+static void playlist_start_order(PlayerControl *control) {
+    control->order_pos = 0;
+    control->current_track = 0;
+    if (control->shuffle_mode && control->playlist) {
+        playlist_shuffle(control->playlist, -1);
+        control->current_track = (int)control->playlist->order[0];
+    }
+}
+
+static int queue_append(PlayerControl *control, char **paths, int count) {
+    if (control->queue_count + count > control->queue_capacity) {
+        int new_capacity = control->queue_capacity ? control->queue_capacity : 16;
+        while (new_capacity < control->queue_count + count) new_capacity *= 2;
+        char **grown = realloc(control->queue, new_capacity * sizeof(char *));
+        if (!grown) return -1;
+        control->queue = grown;
+        control->queue_capacity = new_capacity;
+    }
+    memcpy(control->queue + control->queue_count, paths, count * sizeof(char *));
+    control->queue_count += count;
+    return 0;
+}
+
+static char *queue_pop(PlayerControl *control) {
+    if (control->queue_count == 0) return NULL;
+    char *path = control->queue[0];
+    control->queue_count--;
+    memmove(control->queue, control->queue + 1, control->queue_count * sizeof(char *));
+    return path;
+}
+
+static void queue_clear(PlayerControl *control) {
+    free_names(control->queue, control->queue_count, 0);
+    control->queue = NULL;
+    control->queue_count = 0;
+    control->queue_capacity = 0;
+}
+
+static inline int16_t saturate_s16(long value) {
+    if (value > INT16_MAX) return INT16_MAX;
+    if (value < INT16_MIN) return INT16_MIN;
+    return (int16_t)value;
+}
+
+static inline float clamp_s16_range(float value) {
+    if (value > 32767.0f) return 32767.0f;
+    if (value < -32768.0f) return -32768.0f;
+    return value;
+}
+
+static void gain_ramp_s16_tail(int16_t *samples, int first, int frames, float gain, float step) {
+    for (int f = first; f < frames; f++) {
+        float g = gain + (float)f * step;
+        samples[2 * f] = saturate_s16(lrintf((float)samples[2 * f] * g));
+        samples[2 * f + 1] = saturate_s16(lrintf((float)samples[2 * f + 1] * g));
+    }
+}
+
+static void gain_ramp_s16_scalar(int16_t *samples, int frames, float gain, float step) {
+    gain_ramp_s16_tail(samples, 0, frames, gain, step);
+}
+
+static void mix_s16_scalar(int16_t *dst, const int16_t *src, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = saturate_s16((long)dst[i] + src[i]);
+    }
+}
+
+static void s16_to_f32_scalar(float *dst, const int16_t *src, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = (float)src[i] * (1.0f / 32768.0f);
+    }
+}
+
+static void f32_to_s16_scalar(int16_t *dst, const float *src, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = (int16_t)lrintf(clamp_s16_range(src[i] * 32768.0f));
+    }
+}
+
+static void peak_rms_s16_scalar(const int16_t *samples, int count, int *peak, uint64_t *sum_squares) {
+    int max_abs = 0;
+    uint64_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        int v = samples[i];
+        int a = v < 0 ? -v : v;
+        if (a > max_abs) max_abs = a;
+        sum += (uint64_t)((int64_t)v * v);
+    }
+    *peak = max_abs;
+    *sum_squares = sum;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static void gain_ramp_s16_sse2(int16_t *samples, int frames, float gain, float step) {
+    const __m128 offsets_lo = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+    const __m128 offsets_hi = _mm_setr_ps(2.0f, 2.0f, 3.0f, 3.0f);
+    const __m128 gain_v = _mm_set1_ps(gain);
+    const __m128 step_v = _mm_set1_ps(step);
+    int f = 0;
+    for (; f + 4 <= frames; f += 4) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(samples + 2 * f));
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16));
+        __m128 base = _mm_set1_ps((float)f);
+        __m128 g_lo = _mm_add_ps(gain_v, _mm_mul_ps(_mm_add_ps(base, offsets_lo), step_v));
+        __m128 g_hi = _mm_add_ps(gain_v, _mm_mul_ps(_mm_add_ps(base, offsets_hi), step_v));
+        __m128i out_lo = _mm_cvtps_epi32(_mm_mul_ps(lo, g_lo));
+        __m128i out_hi = _mm_cvtps_epi32(_mm_mul_ps(hi, g_hi));
+        _mm_storeu_si128((__m128i *)(samples + 2 * f), _mm_packs_epi32(out_lo, out_hi));
+    }
+    gain_ramp_s16_tail(samples, f, frames, gain, step);
+}
+
+__attribute__((target("sse2")))
+static void mix_s16_sse2(int16_t *dst, const int16_t *src, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_adds_epi16(a, b));
+    }
+    mix_s16_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void s16_to_f32_sse2(float *dst, const int16_t *src, int count) {
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    s16_to_f32_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void f32_to_s16_sse2(int16_t *dst, const float *src, int count) {
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 hi_limit = _mm_set1_ps(32767.0f);
+    const __m128 lo_limit = _mm_set1_ps(-32768.0f);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), hi_limit), lo_limit);
+        __m128 b = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale), hi_limit), lo_limit);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+    f32_to_s16_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void peak_rms_s16_sse2(const int16_t *samples, int count, int *peak, uint64_t *sum_squares) {
+    __m128i max_v = _mm_set1_epi16(0);
+    __m128i min_v = _mm_set1_epi16(0);
+    __m128i sum_v = _mm_setzero_si128();
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(samples + i));
+        max_v = _mm_max_epi16(max_v, in);
+        min_v = _mm_min_epi16(min_v, in);
+        __m128i sq = _mm_madd_epi16(in, in);
+        sum_v = _mm_add_epi64(sum_v, _mm_unpacklo_epi32(sq, zero));
+        sum_v = _mm_add_epi64(sum_v, _mm_unpackhi_epi32(sq, zero));
+    }
+    int16_t maxs[8], mins[8];
+    uint64_t sums[2];
+    _mm_storeu_si128((__m128i *)maxs, max_v);
+    _mm_storeu_si128((__m128i *)mins, min_v);
+    _mm_storeu_si128((__m128i *)sums, sum_v);
+    int tail_peak;
+    uint64_t tail_sum;
+    peak_rms_s16_scalar(samples + i, count - i, &tail_peak, &tail_sum);
+    for (int k = 0; k < 8; k++) {
+        if (maxs[k] > tail_peak) tail_peak = maxs[k];
+        if (-mins[k] > tail_peak) tail_peak = -mins[k];
+    }
+    *peak = tail_peak;
+    *sum_squares = sums[0] + sums[1] + tail_sum;
+}
+
+__attribute__((target("avx2")))
+static void gain_ramp_s16_avx2(int16_t *samples, int frames, float gain, float step) {
+    const __m256 offsets_lo = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+    const __m256 offsets_hi = _mm256_setr_ps(4.0f, 4.0f, 5.0f, 5.0f, 6.0f, 6.0f, 7.0f, 7.0f);
+    const __m256 gain_v = _mm256_set1_ps(gain);
+    const __m256 step_v = _mm256_set1_ps(step);
+    int f = 0;
+    for (; f + 8 <= frames; f += 8) {
+        __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(samples + 2 * f))));
+        __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(samples + 2 * f + 8))));
+        __m256 base = _mm256_set1_ps((float)f);
+        __m256 g_lo = _mm256_add_ps(gain_v, _mm256_mul_ps(_mm256_add_ps(base, offsets_lo), step_v));
+        __m256 g_hi = _mm256_add_ps(gain_v, _mm256_mul_ps(_mm256_add_ps(base, offsets_hi), step_v));
+        __m256i out_lo = _mm256_cvtps_epi32(_mm256_mul_ps(lo, g_lo));
+        __m256i out_hi = _mm256_cvtps_epi32(_mm256_mul_ps(hi, g_hi));
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(out_lo, out_hi), 0xD8);
+        _mm256_storeu_si256((__m256i *)(samples + 2 * f), packed);
+    }
+    gain_ramp_s16_tail(samples, f, frames, gain, step);
+}
+
+__attribute__((target("avx2")))
+static void mix_s16_avx2(int16_t *dst, const int16_t *src, int count) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_adds_epi16(a, b));
+    }
+    mix_s16_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void s16_to_f32_avx2(float *dst, const int16_t *src, int count) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i in = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + i)));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(in), scale));
+    }
+    s16_to_f32_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void f32_to_s16_avx2(int16_t *dst, const float *src, int count) {
+    const __m256 scale = _mm256_set1_ps(32768.0f);
+    const __m256 hi_limit = _mm256_set1_ps(32767.0f);
+    const __m256 lo_limit = _mm256_set1_ps(-32768.0f);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256 a = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale), hi_limit), lo_limit);
+        __m256 b = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale), hi_limit), lo_limit);
+        __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    f32_to_s16_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void peak_rms_s16_avx2(const int16_t *samples, int count, int *peak, uint64_t *sum_squares) {
+    __m256i max_v = _mm256_setzero_si256();
+    __m256i min_v = _mm256_setzero_si256();
+    __m256i sum_v = _mm256_setzero_si256();
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i in = _mm256_loadu_si256((const __m256i *)(samples + i));
+        max_v = _mm256_max_epi16(max_v, in);
+        min_v = _mm256_min_epi16(min_v, in);
+        __m256i sq = _mm256_madd_epi16(in, in);
+        sum_v = _mm256_add_epi64(sum_v, _mm256_unpacklo_epi32(sq, zero));
+        sum_v = _mm256_add_epi64(sum_v, _mm256_unpackhi_epi32(sq, zero));
+    }
+    int16_t maxs[16], mins[16];
+    uint64_t sums[4];
+    _mm256_storeu_si256((__m256i *)maxs, max_v);
+    _mm256_storeu_si256((__m256i *)mins, min_v);
+    _mm256_storeu_si256((__m256i *)sums, sum_v);
+    int tail_peak;
+    uint64_t tail_sum;
+    peak_rms_s16_scalar(samples + i, count - i, &tail_peak, &tail_sum);
+    for (int k = 0; k < 16; k++) {
+        if (maxs[k] > tail_peak) tail_peak = maxs[k];
+        if (-mins[k] > tail_peak) tail_peak = -mins[k];
+    }
+    *peak = tail_peak;
+    *sum_squares = sums[0] + sums[1] + sums[2] + sums[3] + tail_sum;
+}
+#endif
+
+typedef void (*GainRampFn)(int16_t *samples, int frames, float gain, float step);
+
+typedef struct SampleKernels {
+    const char *name;
+    const char *cpu_feature;
+    GainRampFn gain_ramp_s16;
+    void (*mix_s16)(int16_t *dst, const int16_t *src, int count);
+    void (*s16_to_f32)(float *dst, const int16_t *src, int count);
+    void (*f32_to_s16)(int16_t *dst, const float *src, int count);
+    void (*peak_rms_s16)(const int16_t *samples, int count, int *peak, uint64_t *sum_squares);
+} SampleKernels;
+
+static const SampleKernels kernel_variants[] = {
+    {"scalar", NULL, gain_ramp_s16_scalar, mix_s16_scalar, s16_to_f32_scalar, f32_to_s16_scalar, peak_rms_s16_scalar},
+#if defined(__x86_64__) || defined(__i386__)
+    {"sse2", "sse2", gain_ramp_s16_sse2, mix_s16_sse2, s16_to_f32_sse2, f32_to_s16_sse2, peak_rms_s16_sse2},
+    {"avx2", "avx2", gain_ramp_s16_avx2, mix_s16_avx2, s16_to_f32_avx2, f32_to_s16_avx2, peak_rms_s16_avx2},
+#endif
+};
+#define KERNEL_VARIANT_COUNT ((int)(sizeof(kernel_variants) / sizeof(kernel_variants[0])))
+
+static SampleKernels kernels;
+
+static int kernel_variant_supported(const SampleKernels *variant) {
+    if (!variant->cpu_feature) return 1;
+#if defined(__x86_64__) || defined(__i386__)
+    if (strcmp(variant->cpu_feature, "sse2") == 0) return __builtin_cpu_supports("sse2");
+    if (strcmp(variant->cpu_feature, "avx2") == 0) return __builtin_cpu_supports("avx2");
+#endif
+    return 0;
+}
+
+static void sample_kernels_init(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+#endif
+    const char *forced = getenv("TAPRAW_KERNELS");
+    kernels = kernel_variants[0];
+    for (int v = 1; v < KERNEL_VARIANT_COUNT; v++) {
+        if (kernel_variant_supported(&kernel_variants[v])) kernels = kernel_variants[v];
+    }
+    for (int v = 0; forced && v < KERNEL_VARIANT_COUNT; v++) {
+        if (strcmp(forced, kernel_variants[v].name) == 0 && kernel_variant_supported(&kernel_variants[v])) {
+            kernels = kernel_variants[v];
+        }
+    }
+}
+
+static void format_frame_time(char *out, size_t size, long long frames) {
+    long long ms = frames * 1000 / RATE;
+    snprintf(out, size, "%lld:%02lld.%03lld", ms / 60000, ms / 1000 % 60, ms % 1000);
+}
+
+static float fade_tables[FADE_CURVES][FADE_TABLE_SIZE + 2];
+static const char *fade_curve_names[FADE_CURVES] = {"linear", "equal-power", "exponential"};
+
+static void fade_tables_init(void) {
+    for (int i = 0; i <= FADE_TABLE_SIZE; i++) {
+        double x = (double)i / FADE_TABLE_SIZE;
+        fade_tables[FADE_LINEAR][i] = (float)x;
+        fade_tables[FADE_EQUAL_POWER][i] = (float)sin(x * M_PI / 2.0);
+        fade_tables[FADE_EXPONENTIAL][i] = (i == 0) ? 0.0f : (float)pow(10.0, (x - 1.0) * 3.0);
+    }
+    for (int c = 0; c < FADE_CURVES; c++) {
+        fade_tables[c][FADE_TABLE_SIZE + 1] = fade_tables[c][FADE_TABLE_SIZE];
+    }
+}
+
+static void fade_ramp_s16(int16_t *samples, int count, const float *table, uint64_t phase, uint64_t phase_step, int dir) {
+    int done = 0;
+    while (done < count) {
+        uint32_t idx = (uint32_t)(phase >> 32);
+        uint32_t frac = (uint32_t)phase;
+        uint64_t run = (dir > 0)
+            ? ((1ULL << 32) - frac + phase_step - 1) / phase_step
+            : frac / phase_step + 1;
+        int n = (run < (uint64_t)(count - done)) ? (int)run : count - done;
+        float slope = table[idx + 1] - table[idx];
+        float gain = table[idx] + slope * ((float)frac * (1.0f / 4294967296.0f));
+        float step = slope * ((float)phase_step * (1.0f / 4294967296.0f)) * (float)dir;
+        kernels.gain_ramp_s16(samples + 2 * done, n, gain, step);
+        done += n;
+        phase = (dir > 0) ? phase + (uint64_t)n * phase_step : phase - (uint64_t)n * phase_step;
+    }
+}
+
+static void apply_fade(PlayerControl *ctrl, int fade_dir, char *buffer, int size) {
+    int16_t *samples = (int16_t *)buffer;
+    int frames = size / FRAME_SIZE;
+    int pos = ctrl->current_fade;
+    int count = (fade_dir > 0) ? FADE_FRAMES - pos : pos;
+    if (count > frames) count = frames;
+    if (count < 0) count = 0;
+    fade_ramp_s16(samples, count, fade_tables[ctrl->fade_curve], (uint64_t)pos * FADE_PHASE_STEP, FADE_PHASE_STEP, fade_dir);
+    if (fade_dir < 0 && count < frames) {
+        memset(samples + 2 * count, 0, (size_t)(frames - count) * FRAME_SIZE);
+    }
+    ctrl->current_fade = pos + fade_dir * count;
+    trace_event("fade", 'C', ctrl->current_fade);
+    if (fade_dir < 0 && ctrl->current_fade <= 0) {
+        ctrl->fading_out = 0;
+        ctrl->current_fade = 0;
+        ctrl->is_silent = 1;
+        if (!ctrl->paused) {
+            ctrl->stop = 1;
+        display_message(STATUS, "Fade completed, stopping");
+        }
+    } else if (fade_dir > 0 && ctrl->current_fade >= FADE_FRAMES) {
+        ctrl->fading_in = 0;
+        ctrl->current_fade = FADE_FRAMES;
+        ctrl->is_silent = 0;
+    }
+}
+
+ void lock_and_signal(PlayerControl *control, void (*action)(PlayerControl *));
+ void cleanup_playlist(PlayerControl *control) {
+    if (!control) return;
+    Playlist *old_list = control->playlist;
+    char *old_dir = control->playlist_dir;
+    control->playlist = NULL;
+    control->playlist_size = 0;
+    control->current_track = 0;
+    control->playlist_dir = NULL;
+    control->playlist_generation++;
+    control->playlist_loading = 0;
+    free(old_list);
     if (old_dir) {
         free(old_dir);
     }
@@ -865,10 +2354,11 @@ static void reset_playback_fields(PlayerControl *control) {
     control->is_silent = 0;
     control->fading_in = 0;
     control->fading_out = 0;
-    control->current_fade = FADE_STEPS;
+    control->current_fade = FADE_FRAMES;
     control->bytes_read = 0LL;
     control->duration = 0.0;
     control->seek_delta = 0;
+    control->seek_target = -1;
 }
 
 void action_set_stop(PlayerControl *control, void *user_data) {
@@ -885,7 +2375,7 @@ control->playlist_mode = 0;
 struct LoadMainData {
 const char *dir_path;
 };
-static int load_raw_files(const char *dir_path, char ***files_out, int *count_out);
+static int load_raw_files(const char *dir_path, Playlist **playlist_out);
 void action_load_main(PlayerControl *control, void *user_data) {
     struct LoadMainData *d = user_data;
     while (control->stop == 1) {
@@ -898,30 +2388,25 @@ void action_load_main(PlayerControl *control, void *user_data) {
             break;
         }
     }
-    if (control->playlist) {
-        free_names(control->playlist, control->playlist_size, 0);
-    }
-    control->playlist = NULL;
+    SAFE_FREE(control->playlist);
     control->playlist_size = 0;
-    control->playlist_capacity = 0;
     control->current_track = 0;
     control->playlist_dir = NULL;
-    char **entries = NULL;
-    int count = 0;
-    if (load_raw_files(d->dir_path, &entries, &count) != 0 || count == 0) {
-        if (entries) free(entries);
+    control->playlist_generation++;
+    control->playlist_loading = 0;
+    Playlist *playlist = NULL;
+    if (load_raw_files(d->dir_path, &playlist) != 0 || !playlist) {
         control->playlist_mode = 0;
         return;
     }
-    control->playlist = entries;
-    control->playlist_capacity = count;
-    control->playlist_size = count;
-    control->current_track = 0;
+    control->playlist = playlist;
+    control->playlist_size = playlist->count;
+    playlist_start_order(control);
     control->playlist_mode = 1;
-    if (control->playlist_size > 0 && control->playlist[0]) {
+    if (control->playlist_size > 0) {
         if (control->filename) free(control->filename);
-        control->filename = strdup(control->playlist[0]);
-        pthread_cond_signal(&control->cond);
+        control->filename = playlist_track_dup(control->playlist, control->current_track);
+        pthread_cond_broadcast(&control->cond);
         assign_safe_strdup(&control->playlist_dir, d->dir_path);
     }
 }
@@ -933,7 +2418,7 @@ struct LoopData {
 void with_mutex(PlayerControl *control, void (*action)(PlayerControl *, void *), void *user_data, int do_signal) {
     SAFE_MUTEX_LOCK(&control->mutex);
     if (action) action(control, user_data);
-    if (do_signal) pthread_cond_signal(&control->cond);
+    if (do_signal) pthread_cond_broadcast(&control->cond);
     pthread_mutex_unlock(&control->mutex);
 }
 
@@ -948,19 +2433,26 @@ PlayerControl player_control = {
     .current_filename = NULL,
     .paused = 0,
     .loop_mode = 0,
+    .loop_a = -1,
+    .loop_b = -1,
     .playlist = NULL,
     .playlist_size = 0,
-    .playlist_capacity = 0,
     .current_track = 0,
     .playlist_mode = 0,
     .seek_delta = 0,
+    .seek_target = -1,
     .duration = 0.0,
     .bytes_read = 0LL,
     .is_silent = 0,
     .fading_out = 0,
     .fading_in = 0,
-    .current_fade = FADE_STEPS,
+    .current_fade = FADE_FRAMES,
     .playlist_dir = NULL,
+    .playlist_generation = 0,
+    .playlist_loading = 0,
+    .shuffle_mode = 0,
+    .repeat_all = 0,
+    .order_pos = 0,
 };
 
 void top(WINDOW *win)
@@ -999,7 +2491,12 @@ void draw_menu_frame(WINDOW *win)
 
 draw_single_frame(win, 3, usable_height, "FILES & DIRECTORIES", 0);
 }
-void perform_seek(PlayerControl *control, snd_pcm_t *handle);
+void perform_seek(PlayerControl *control, OutputSink *sink);
+
+static int seek_pending(const PlayerControl *control) {
+    return control->seek_delta != 0 || control->seek_target >= 0;
+}
+
 static int is_raw_file(const char *name) {
     if (!name) return 0;
     size_t len = strlen(name);
@@ -1148,7 +2645,14 @@ void update_file_list(void) {
     free_file_list();
 int count = 0;
 FileEntry *entries = NULL;
-if (scan_directory(current_dir, 0, (void **)&entries, &count, 0) != 0) {
+int cached = listing_take(current_dir, &entries, &count) == 0;
+int scanned = 0;
+if (!cached) {
+    trace_event("scan", 'B', 0);
+    scanned = scan_directory(current_dir, 0, (void **)&entries, &count, 0);
+    trace_event("scan", 'E', 0);
+}
+if (!cached && scanned != 0) {
     file_list = calloc(1, sizeof(FileEntry));
     file_list[0].name = strdup("(access denied)");
     file_list[0].is_dir = 0;
@@ -1167,7 +2671,7 @@ if (scan_directory(current_dir, 0, (void **)&entries, &count, 0) != 0) {
     free(entries);
     return;
 }
-qsort(entries, count, sizeof(FileEntry), file_entry_cmp);
+if (!cached) qsort(entries, count, sizeof(FileEntry), file_entry_cmp);
 file_list = entries;
 file_count = count;
 selected_index = 0;
@@ -1324,6 +2828,11 @@ if (!file_list[i].is_dir) {
 		wchar_t space_ch = L' ';
 		draw_fill_line(win, row, 3 + printed, cursor_end - (3 + printed), &space_ch, 1, 1);
 	    }
+    if (file_list[i].marked) {
+        wattron(win, A_BOLD);
+        mvwaddwstr(win, row, 2, L"+");
+        wattroff(win, A_BOLD);
+    }
 }
     if (file_count > visible_lines) {
         int scroll_height       = max_y - 8;
@@ -1360,167 +2869,702 @@ if (last_list_row < safe_clear_end) {
 
 static void cleanup_playlist_and_filename(PlayerControl *control) {
     if (control->playlist) {
-        free_names(control->playlist, control->playlist_size, 0);
-        control->playlist = NULL;
+        SAFE_FREE(control->playlist);
         control->playlist_size = 0;
-        control->playlist_capacity = 0;
         free(control->playlist_dir);
         control->playlist_dir = NULL;
     }
+    control->playlist_loading = 0;
     if (control->filename) {
 SAFE_FREE(control->filename);
     }
 }
 
-void *player_thread(void *arg) {
-    PlayerControl *control = (PlayerControl *)arg;
-    unsigned int rate = 44100;
-    int channels = 2;
-    snd_pcm_t *handle = NULL;
-    FILE *file = NULL;
-    int local_paused = 0;
-    const int buffer_size = 4096;
-    char buffer[buffer_size];
-    unsigned int poll_count = 0;
-    struct pollfd *poll_fds = NULL;
+typedef struct PrefetchSlot {
+    FILE *file;
+    char *path;
+    long long size;
+} PrefetchSlot;
 
-    while (1) {
-        pthread_mutex_lock(&control->mutex);
-        if (control->quit) {
-            pthread_mutex_unlock(&control->mutex);
-            break;
-        }
-if (control->stop) {
-        safe_cleanup_resources(&file, &handle, &poll_fds, &control->current_filename);
-        cleanup_playlist_and_filename(control);
-        if (control->playlist_mode) {
- display_message(STATUS, "Playlist completed");
-        }
-        control->stop = 0;
-        control->duration = 0.0;
-        control->bytes_read = 0LL;
-        control->paused = 0;
-        control->playlist_mode = 0;
-        control->current_track = 0;
-        pthread_cond_signal(&control->cond);
-        pthread_mutex_unlock(&control->mutex);
-        continue;
+static void prefetch_release(PrefetchSlot *slot) {
+    if (slot->file) {
+        fclose(slot->file);
+        slot->file = NULL;
     }
-        if (control->filename && (!control->current_filename || strcmp(control->filename, control->current_filename) != 0)) {
-safe_cleanup_resources(&file, &handle, NULL, &control->current_filename);
-    free(poll_fds); poll_fds = NULL;
+    SAFE_FREE(slot->path);
+    slot->size = 0;
+}
 
-    file = open_audio_file(control->filename);
-    if (file) {
-        struct stat st;
-        if (fstat(fileno(file), &st) == 0) {
-            long file_size = st.st_size;
-            control->duration = (double)file_size / BYTES_PER_SECOND;
-            control->bytes_read = 0LL;
-        } else {
-            control->duration = 0.0;
-            control->bytes_read = 0LL;
-        }
+static void prefetch_open(PrefetchSlot *slot, const char *path, long long readahead) {
+    prefetch_release(slot);
+    slot->path = safe_strdup(path);
+    if (!slot->path) return;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return;
+    }
+    posix_fadvise(fd, 0, readahead, POSIX_FADV_WILLNEED);
+    slot->file = fdopen(fd, "rb");
+    if (!slot->file) {
+        close(fd);
+        return;
+    }
+    slot->size = st.st_size;
+}
 
-        handle = init_audio_device(rate, channels);
-        if (!handle) {
-            safe_cleanup_resources(&file, &handle, &poll_fds, NULL);
-            pthread_mutex_unlock(&control->mutex);
-            continue;
-        }
-        control->current_file = file;
-        control->current_filename = (control->filename) ? SAFE_STRDUP(control->filename) : NULL;
-if (control->current_filename) {
-long original_pos = ftell(file);
-if (fseek(file, 0, SEEK_END) == 0) {
-    long file_size = ftell(file);
-    fseek(file, original_pos, SEEK_SET);
-    control->duration = (double)file_size / BYTES_PER_SECOND;
-} else {
-    control->duration = 0.0;
+static void prefetch_release_all(PrefetchSlot *slots) {
+    for (int i = 0; i < PREFETCH_SLOTS; i++) prefetch_release(&slots[i]);
 }
-                            control->is_silent = 0;
-	                    control->fading_in = 0;
-	                    control->fading_out = 0;
-	                    control->current_fade = FADE_STEPS;
-                    poll_count = snd_pcm_poll_descriptors_count(handle);
- if (poll_count > 0) {
-     poll_fds = malloc(poll_count * sizeof(struct pollfd));
-     if (poll_fds) {
-         snd_pcm_poll_descriptors(handle, poll_fds, poll_count);
-     } else {
-safe_cleanup_resources(&file, &handle, NULL, NULL);
-         continue;
-     }
- }
-			        char silence_buffer[16384];
-			        memset(silence_buffer, 0, sizeof(silence_buffer));
-			        snd_pcm_sframes_t frames_to_write = sizeof(silence_buffer) / FRAME_SIZE;
-			        snd_pcm_sframes_t written = 0;
-			        while (written < frames_to_write) {
-			            snd_pcm_sframes_t w = snd_pcm_writei(handle,
-			                                                 silence_buffer + written * FRAME_SIZE,
-			                                                 frames_to_write - written);
-			            if (w < 0) {
-			                snd_pcm_recover(handle, w, 1);
-			                continue;
-			            }
-			            written += w;
-			        }
-                } else {
-SAFE_FREE(control->filename);
-                }
-            } else {
-                free(control->filename);
-                control->filename = NULL;
-            }
+
+static int prefetch_find(PrefetchSlot *slots, const char *path) {
+    for (int i = 0; i < PREFETCH_SLOTS; i++) {
+        if (slots[i].path && strcmp(slots[i].path, path) == 0) return i;
+    }
+    return -1;
+}
+
+static FILE *prefetch_take(PrefetchSlot *slots, const char *path, long long *size_out) {
+    int index = prefetch_find(slots, path);
+    if (index < 0) return NULL;
+    FILE *file = slots[index].file;
+    *size_out = slots[index].size;
+    slots[index].file = NULL;
+    prefetch_release(&slots[index]);
+    return file;
+}
+
+static long long crossfade_byte_count(PlayerControl *control) {
+    return (long long)control->crossfade_ms * RATE / 1000 * FRAME_SIZE;
+}
+
+static void prefetch_upcoming(PlayerControl *control, PrefetchSlot *slots) {
+    char path[PATH_MAX];
+    char *missing[PREFETCH_SLOTS] = {0};
+    int keep[PREFETCH_SLOTS] = {0};
+    int missing_count = 0;
+    pthread_mutex_lock(&control->mutex);
+    long long remaining = (long long)(control->duration * BYTES_PER_SECOND) - control->bytes_read;
+    long long crossfade_bytes = crossfade_byte_count(control);
+    for (int i = 0; i < PREFETCH_SLOTS; i++) {
+        const char *next = NULL;
+        if (i < control->queue_count) {
+            next = control->queue[i];
+        } else if (control->playlist_mode && (control->queue_count > 0 || remaining < PREFETCH_AHEAD_BYTES + crossfade_bytes)) {
+            int next_pos = 0;
+            int next_track = playlist_next_track(control, &next_pos);
+            if (next_track >= 0 && playlist_track_path(control->playlist, next_track, path, sizeof(path)) == 0)
+                next = path;
         }
-        pthread_mutex_unlock(&control->mutex);
+        if (!next) break;
+        int found = prefetch_find(slots, next);
+        if (found >= 0) keep[found] = 1;
+        else missing[missing_count++] = safe_strdup(next);
+        if (i >= control->queue_count) break;
+    }
+    pthread_mutex_unlock(&control->mutex);
+    for (int m = 0; m < missing_count; m++) {
+        for (int i = 0; missing[m] && i < PREFETCH_SLOTS; i++) {
+            if (keep[i]) continue;
+            prefetch_open(&slots[i], missing[m], PREFETCH_READAHEAD_BYTES + crossfade_bytes);
+            keep[i] = 1;
+            break;
+        }
+        free(missing[m]);
+    }
+}
 
-	        if (handle && file && !local_paused) {
-	            if (!poll_fds || poll_count <= 0) {
-	                usleep(100000);
-	                continue;
-	            }
-	            if (poll(poll_fds, poll_count, 100) < 0) continue;
+typedef struct TrackEvent {
+    int finished;
+    double duration;
+    char *path;
+} TrackEvent;
 
-            unsigned short revents;
-            snd_pcm_poll_descriptors_revents(handle, poll_fds, poll_count, &revents);
-            if (revents & POLLOUT) {
-SAFE_MUTEX_LOCK(&control->mutex);
-perform_seek(control, handle);
-    if (control->seek_delta != 0) {
-        usleep(150000);
-        continue;
+typedef struct TrackEvents {
+    TrackEvent *items;
+    int count;
+    int capacity;
+    int enabled;
+    char *open_path;
+} TrackEvents;
+
+static TrackEvents track_events;
+
+static void track_event_push(int finished, const char *path, double duration) {
+    if (track_events.count == track_events.capacity) {
+        int capacity = track_events.capacity ? track_events.capacity * 2 : 16;
+        TrackEvent *items = realloc(track_events.items, (size_t)capacity * sizeof(TrackEvent));
+        if (!items) return;
+        track_events.items = items;
+        track_events.capacity = capacity;
     }
-pthread_mutex_unlock(&control->mutex);
+    TrackEvent *event = &track_events.items[track_events.count++];
+    event->finished = finished;
+    event->duration = duration;
+    event->path = safe_strdup(path);
+}
 
-size_t read_size;
-		pthread_mutex_lock(&control->mutex);
-		if (control->is_silent) {
+static void track_event_finish(void) {
+    if (!track_events.open_path) return;
+    track_event_push(1, track_events.open_path, 0.0);
+    SAFE_FREE(track_events.open_path);
+}
+
+static void track_event_start(const PlayerControl *control) {
+    if (!track_events.enabled || !control->current_filename) return;
+    track_event_finish();
+    track_events.open_path = safe_strdup(control->current_filename);
+    track_event_push(0, control->current_filename, control->duration);
+}
+
+typedef struct Crossfade {
+    FILE *file;
+    char *path;
+    long long size;
+    long long bytes_read;
+    int from_queue;
+    int track;
+    int order_pos;
+    int lead;
+    int frames;
+    int done;
+    long long out_pos;
+} Crossfade;
+
+static void crossfade_cancel(Crossfade *xf) {
+    if (xf->file) fclose(xf->file);
+    SAFE_FREE(xf->path);
+    memset(xf, 0, sizeof(*xf));
+}
+
+static void crossfade_begin(PlayerControl *control, PrefetchSlot *slots, Crossfade *xf, long long remaining) {
+    char path[PATH_MAX];
+    const char *next = NULL;
+    int next_pos = 0;
+    int next_track = -1;
+    if (control->queue_count > 0) {
+        next = control->queue[0];
+    } else if (control->playlist_mode) {
+        next_track = playlist_next_track(control, &next_pos);
+        if (next_track >= 0 && playlist_track_path(control->playlist, next_track, path, sizeof(path)) == 0) next = path;
+    }
+    if (!next) return;
+    if (xf->path && strcmp(xf->path, next) == 0) return;
+    crossfade_cancel(xf);
+    xf->path = safe_strdup(next);
+    if (!xf->path) return;
+    xf->file = prefetch_take(slots, next, &xf->size);
+    if (!xf->file) {
+        xf->file = open_audio_file(next);
+        struct stat st;
+        if (xf->file && fstat(fileno(xf->file), &st) == 0) xf->size = st.st_size;
+    }
+    if (!xf->file) return;
+    posix_fadvise(fileno(xf->file), 0, crossfade_byte_count(control) + PREFETCH_READAHEAD_BYTES, POSIX_FADV_WILLNEED);
+    if (control->current_file) posix_fadvise(fileno(control->current_file), control->bytes_read, remaining, POSIX_FADV_WILLNEED);
+    xf->from_queue = (next_track < 0);
+    xf->track = next_track;
+    xf->order_pos = next_pos;
+    long long overlap = crossfade_byte_count(control);
+    if (overlap > remaining) overlap = remaining;
+    if (overlap > xf->size / 2) overlap = xf->size / 2 / FRAME_SIZE * FRAME_SIZE;
+    xf->frames = (int)(overlap / FRAME_SIZE);
+    xf->lead = (int)((remaining - overlap) / FRAME_SIZE);
+    xf->done = 0;
+    xf->bytes_read = 0;
+    xf->out_pos = control->bytes_read;
+    if (xf->frames <= 0) crossfade_cancel(xf);
+}
+
+static int crossfade_mix(Crossfade *xf, char *buffer, char *incoming, int out_bytes, int buffer_size) {
+    int out_frames = out_bytes / FRAME_SIZE;
+    int lead = xf->lead < out_frames ? xf->lead : out_frames;
+    xf->lead -= lead;
+    out_frames -= lead;
+    char *mix = buffer + lead * FRAME_SIZE;
+    int space = buffer_size - lead * FRAME_SIZE;
+    if (xf->lead > 0) return lead * FRAME_SIZE;
+    uint64_t read_begin = monotonic_us();
+    int in_bytes = (int)fread(incoming, 1, space, xf->file);
+    histogram_record(&audio_stats.read, (unsigned long)(monotonic_us() - read_begin));
+    in_bytes -= in_bytes % FRAME_SIZE;
+    xf->bytes_read += in_bytes;
+    if (out_frames > xf->frames - xf->done) out_frames = xf->frames - xf->done;
+    int total = (in_bytes > out_frames * FRAME_SIZE) ? in_bytes : out_frames * FRAME_SIZE;
+    memset(mix + out_frames * FRAME_SIZE, 0, space - out_frames * FRAME_SIZE);
+    memset(incoming + in_bytes, 0, space - in_bytes);
+    const float *table = fade_tables[FADE_EQUAL_POWER];
+    uint64_t step = ((uint64_t)FADE_TABLE_SIZE << 32) / (uint64_t)xf->frames;
+    fade_ramp_s16((int16_t *)mix, out_frames, table, (uint64_t)(xf->frames - xf->done) * step, step, -1);
+    fade_ramp_s16((int16_t *)incoming, out_frames, table, (uint64_t)xf->done * step, step, 1);
+    kernels.mix_s16((int16_t *)mix, (const int16_t *)incoming, total / 2);
+    xf->done += out_frames;
+    return lead * FRAME_SIZE + total;
+}
+
+static void crossfade_commit(PlayerControl *control, Crossfade *xf, FILE **file) {
+    fclose(*file);
+    *file = xf->file;
+    control->current_file = xf->file;
+    if (xf->from_queue) {
+        if (control->queue_count > 0 && strcmp(control->queue[0], xf->path) == 0) free(queue_pop(control));
+        control->loop_mode = 0;
+    } else {
+        control->current_track = xf->track;
+        control->order_pos = xf->order_pos;
+    }
+    assign_safe_strdup(&control->current_filename, xf->path);
+    control->track_starts++;
+    trace_event("track open", 'i', (long)control->track_starts);
+    SAFE_FREE(control->filename);
+    control->filename = xf->path;
+    control->duration = (double)xf->size / BYTES_PER_SECOND;
+    control->bytes_read = xf->bytes_read;
+    control->end_fade_from = xf->bytes_read / FRAME_SIZE;
+    track_event_start(control);
+    xf->file = NULL;
+    xf->path = NULL;
+    crossfade_cancel(xf);
+}
+
+typedef struct LoopSource {
+    FILE *file;
+    char *path;
+    const char *data;
+    size_t length;
+    long long size;
+    int prepared;
+    int active;
+} LoopSource;
+
+static void loop_source_release(LoopSource *src) {
+    if (src->data) munmap((void *)src->data, src->length);
+    SAFE_FREE(src->path);
+    memset(src, 0, sizeof(*src));
+}
+
+static void loop_source_track(LoopSource *src, PlayerControl *control, FILE *file) {
+    if (src->file == file && src->path && control->current_filename && strcmp(src->path, control->current_filename) == 0) return;
+    loop_source_release(src);
+    src->file = file;
+    src->path = safe_strdup(control->current_filename);
+    control->loop_a = -1;
+    control->loop_b = -1;
+}
+
+static void loop_source_prepare(LoopSource *src) {
+    if (src->prepared) return;
+    src->prepared = 1;
+    struct stat st;
+    if (fstat(fileno(src->file), &st) != 0) return;
+    src->size = st.st_size;
+    if (st.st_size <= 0) return;
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(src->file), 0);
+    if (data == MAP_FAILED) return;
+    src->data = data;
+    src->length = (size_t)st.st_size;
+}
+
+static int loop_region(PlayerControl *control, LoopSource *src, long long *start, long long *end) {
+    int ab = control->loop_a >= 0 && control->loop_b > control->loop_a;
+    if (!ab && !(control->loop_mode && !control->playlist_mode && control->queue_count == 0)) return 0;
+    loop_source_prepare(src);
+    long long limit = src->size - src->size % FRAME_SIZE;
+    *start = ab ? control->loop_a * FRAME_SIZE : 0;
+    *end = ab ? control->loop_b * FRAME_SIZE : limit;
+    if (*end > limit) *end = limit;
+    if (*end <= *start) return 0;
+    if (src->data && !src->active) {
+        long page = sysconf(_SC_PAGESIZE);
+        long long aligned = *start - *start % page;
+        madvise((void *)(src->data + aligned), (size_t)(*end - aligned), MADV_WILLNEED);
+    }
+    return 1;
+}
+
+static void loop_cut_at_b(PlayerControl *control, OutputSink *sink, long long start, long long end) {
+    control->loop_b_pending = 0;
+    if (control->bytes_read <= end) return;
+    long rewound = sink->ops->rewind ? sink->ops->rewind(sink) : 0;
+    control->bytes_read -= (long long)rewound * FRAME_SIZE;
+    if (control->bytes_read < 0 || (rewound <= 0 && sink->ops->delay(sink) > 0)) {
+        sink->ops->drop(sink);
+        control->bytes_read = start;
+    }
+}
+
+static size_t loop_fill(LoopSource *src, char *buffer, size_t size, long long *pos, long long start, long long end) {
+    size_t filled = 0;
+    while (filled < size) {
+        if (*pos >= end || *pos < 0) *pos = start;
+        size_t n = size - filled;
+        if ((long long)n > end - *pos) n = (size_t)(end - *pos);
+        if (src->data) {
+            memcpy(buffer + filled, src->data + *pos, n);
+        } else {
+            ssize_t got = pread(fileno(src->file), buffer + filled, n, *pos);
+            if (got <= 0) break;
+            n = (size_t)got - (size_t)got % FRAME_SIZE;
+            if (n == 0) break;
+        }
+        filled += n;
+        *pos += (long long)n;
+    }
+    return filled;
+}
+
+enum { LATENCY_PLAY, LATENCY_PAUSE, LATENCY_RESUME, LATENCY_SEEK, LATENCY_NEXT, LATENCY_KINDS };
+
+typedef struct LatencyProbe {
+    atomic_int armed;
+    int kind;
+    unsigned long baseline;
+    uint64_t delivered_us;
+    uint64_t audible_us;
+} LatencyProbe;
+
+static LatencyProbe latency_probe;
+
+static unsigned long latency_probe_progress(const PlayerControl *control, int kind) {
+    switch (kind) {
+    case LATENCY_PAUSE: return control->pauses_done;
+    case LATENCY_RESUME: return control->resumes_done;
+    case LATENCY_SEEK: return control->seeks_done;
+    default: return control->track_starts;
+    }
+}
+
+static void latency_probe_check(const PlayerControl *control, long delay, int frames) {
+    if (!atomic_load_explicit(&latency_probe.armed, memory_order_acquire)) return;
+    if (latency_probe_progress(control, latency_probe.kind) == latency_probe.baseline) return;
+    long queued = delay > frames ? delay - frames : 0;
+    latency_probe.delivered_us = monotonic_us();
+    latency_probe.audible_us = latency_probe.delivered_us + (uint64_t)queued * 1000000u / RATE;
+    atomic_store_explicit(&latency_probe.armed, 0, memory_order_release);
+}
+
+static int player_has_new_file(PlayerControl *control) {
+    return control->filename && (!control->current_filename || strcmp(control->filename, control->current_filename) != 0);
+}
+
+static long long pause_wrap(long long pos, long long loop_start, long long loop_end) {
+    if (loop_end <= loop_start) return pos < 0 ? 0 : pos;
+    long long span = loop_end - loop_start;
+    while (pos < loop_start) pos += span;
+    while (pos >= loop_end) pos -= span;
+    return pos;
+}
+
+static int pause_output(PlayerControl *control, OutputSink *sink, FILE *file, long long loop_start, long long loop_end) {
+    int16_t tail[(PAUSE_FADE_FRAMES + PAUSE_TAIL_FRAMES) * CHANNELS];
+    memset(tail, 0, sizeof(tail));
+    pthread_mutex_lock(&control->mutex);
+    int silent = control->is_silent;
+    if (!silent) {
+        long back = sink->ops->rewind ? sink->ops->rewind(sink) : 0;
+        if (back <= 0) {
+            back = sink->ops->delay(sink);
+            if (back > 0) sink->ops->drop(sink);
+        }
+        if (back > 0) control->bytes_read = pause_wrap(control->bytes_read - (long long)back * FRAME_SIZE, loop_start, loop_end);
+    }
+    long long pos = control->bytes_read;
+    int curve = control->fade_curve;
+    pthread_mutex_unlock(&control->mutex);
+    if (!silent) {
+        ssize_t got = pread(fileno(file), tail, PAUSE_FADE_FRAMES * FRAME_SIZE, pos);
+        int frames = (got > 0) ? (int)(got / FRAME_SIZE) : 0;
+        uint64_t step = ((uint64_t)FADE_TABLE_SIZE << 32) / PAUSE_FADE_FRAMES;
+        fade_ramp_s16(tail, frames, fade_tables[curve], (uint64_t)PAUSE_FADE_FRAMES * step, step, -1);
+        pthread_mutex_lock(&control->mutex);
+        control->bytes_read = pause_wrap(pos + (long long)frames * FRAME_SIZE, loop_start, loop_end);
+        fseek(file, control->bytes_read, SEEK_SET);
+        pthread_mutex_unlock(&control->mutex);
+    }
+    sink->ops->write(sink, (const char *)tail, PAUSE_FADE_FRAMES + PAUSE_TAIL_FRAMES);
+    long delay = sink->ops->delay(sink);
+    pthread_mutex_lock(&control->mutex);
+    control->pauses_done++;
+    latency_probe_check(control, delay, PAUSE_FADE_FRAMES + PAUSE_TAIL_FRAMES);
+    pthread_mutex_unlock(&control->mutex);
+    if (delay > PAUSE_TAIL_FRAMES) {
+        long long ns = (long long)(delay - PAUSE_TAIL_FRAMES) * 1000000000LL / RATE;
+        struct timespec ts = {ns / 1000000000LL, ns % 1000000000LL};
+        nanosleep(&ts, NULL);
+    }
+    if (sink->ops->pause(sink, 1) == 0) return OUTPUT_HW_PAUSED;
+    sink->ops->drop(sink);
+    return OUTPUT_STOPPED;
+}
+
+static void resume_output(OutputSink *sink, int output) {
+    if (output == OUTPUT_HW_PAUSED && sink->ops->pause(sink, 0) == 0) return;
+    sink->ops->drop(sink);
+}
+
+static void apply_end_fade(PlayerControl *control, char *buffer, int size) {
+    int next_pos;
+    if (!control->fade_out_at_end || control->fading_out || control->loop_mode || control->loop_b >= 0 || control->queue_count > 0)
+        return;
+    if (control->playlist_mode && (control->playlist_loading || playlist_next_track(control, &next_pos) >= 0)) return;
+    long long track_frames = llround(control->duration * BYTES_PER_SECOND) / FRAME_SIZE;
+    long long chunk_start = (control->bytes_read - size) / FRAME_SIZE;
+    long long length = track_frames - control->end_fade_from;
+    if (length > FADE_FRAMES) length = FADE_FRAMES;
+    long long remaining = track_frames - chunk_start;
+    int frames = size / FRAME_SIZE;
+    if (chunk_start < control->end_fade_from || length <= 0 || remaining <= 0 || remaining - frames >= length) return;
+    int skip = remaining > length ? (int)(remaining - length) : 0;
+    int count = (remaining < frames ? (int)remaining : frames) - skip;
+    uint64_t step = ((uint64_t)FADE_TABLE_SIZE << 32) / (uint64_t)length;
+    fade_ramp_s16((int16_t *)buffer + skip * CHANNELS, count, fade_tables[control->fade_curve],
+                  (uint64_t)(remaining - skip) * step, step, -1);
+}
+
+void *player_thread(void *arg) {
+    PlayerControl *control = (PlayerControl *)arg;
+    pthread_setname_np(pthread_self(), "tapraw-player");
+    OutputSink *sink = NULL;
+    FILE *file = NULL;
+    int output_state = OUTPUT_RUNNING;
+    const int buffer_size = 4096;
+    char buffer[buffer_size];
+    PrefetchSlot prefetch[PREFETCH_SLOTS] = {{0}};
+    int drain_next = 0;
+    int first_write_pending = 0;
+    struct timespec start_requested = {0};
+    Crossfade crossfade = {0};
+    char incoming[buffer_size];
+    LoopSource loop_source = {0};
+    long long loop_start = 0, loop_end = 0;
+    unsigned long iteration = 0, paced_iteration = 0;
+    uint64_t paced_us = 0;
+    long long paced_period_us = 0;
+    long paced_delay = 0;
+
+    while (1) {
+        iteration++;
+        pthread_mutex_lock(&control->mutex);
+        status_publish(control);
+        if (control->quit) {
+            pthread_mutex_unlock(&control->mutex);
+            break;
+        }
+if (control->stop) {
+        crossfade_cancel(&crossfade);
+        safe_cleanup_resources(&file, NULL, &control->current_filename);
+        control->current_file = NULL;
+        control->delay_frames = 0;
+        track_event_finish();
+        if (sink) sink->ops->drop(sink);
+        prefetch_release_all(prefetch);
+        cleanup_playlist_and_filename(control);
+        if (control->playlist_mode) {
+ display_message(STATUS, "Playlist completed");
+        }
+        control->stop = 0;
+        control->duration = 0.0;
+        control->bytes_read = 0LL;
+        control->level_peak = 0;
+        control->level_rms = 0.0;
+        control->paused = 0;
+        control->playlist_mode = 0;
+        control->current_track = 0;
+        output_state = OUTPUT_RUNNING;
+        pthread_cond_broadcast(&control->cond);
+        pthread_mutex_unlock(&control->mutex);
+        continue;
+    }
+        if (player_has_new_file(control)) {
+    crossfade_cancel(&crossfade);
+    safe_cleanup_resources(&file, NULL, &control->current_filename);
+    control->current_file = NULL;
+    control->delay_frames = 0;
+    track_event_finish();
+    prefetch_release_all(prefetch);
+
+    if (control->handoff_file && control->handoff_path && strcmp(control->handoff_path, control->filename) == 0) {
+        file = control->handoff_file;
+    } else {
+        if (control->handoff_file) fclose(control->handoff_file);
+        file = open_audio_file(control->filename);
+    }
+    control->handoff_file = NULL;
+    SAFE_FREE(control->handoff_path);
+    if (file) {
+        struct stat st;
+        if (fstat(fileno(file), &st) == 0) {
+            long file_size = st.st_size;
+            control->duration = (double)file_size / BYTES_PER_SECOND;
+            control->bytes_read = 0LL;
+        } else {
+            control->duration = 0.0;
+            control->bytes_read = 0LL;
+        }
+        if (!sink) {
+            sink = audio_warmup_take();
+            if (!sink) sink = sink_open(sink_spec);
+        } else if (!drain_next || output_state != OUTPUT_RUNNING) {
+            sink->ops->drop(sink);
+        }
+        drain_next = 0;
+        output_state = OUTPUT_RUNNING;
+        if (!sink) {
+            safe_cleanup_resources(&file, NULL, NULL);
+            SAFE_FREE(control->filename);
+            pthread_mutex_unlock(&control->mutex);
+            continue;
+        }
+        control->current_file = file;
+        control->current_filename = (control->filename) ? SAFE_STRDUP(control->filename) : NULL;
+        if (control->current_filename) {
+            control->track_starts++;
+            trace_event("track open", 'i', (long)control->track_starts);
+            track_event_start(control);
+            control->end_fade_from = 0;
+            control->is_silent = 0;
+            control->fading_out = 0;
+            if (control->fade_in_pending) {
+                control->fading_in = 1;
+                control->current_fade = 0;
+                control->fade_in_pending = 0;
+            } else {
+                control->fading_in = 0;
+                control->current_fade = FADE_FRAMES;
+            }
+            first_write_pending = control->start_pending;
+            start_requested = control->start_requested;
+            control->start_pending = 0;
+        } else {
+            SAFE_FREE(control->filename);
+        }
+    } else {
+        free(control->filename);
+        control->filename = NULL;
+    }
+        }
+        pthread_mutex_unlock(&control->mutex);
+
+	        if (sink && file) {
+	            pthread_mutex_lock(&control->mutex);
+	            int want_pause = control->paused && !seek_pending(control);
+	            pthread_mutex_unlock(&control->mutex);
+	            if (want_pause && output_state == OUTPUT_RUNNING) {
+	                crossfade_cancel(&crossfade);
+	                output_state = pause_output(control, sink, file, loop_source.active ? loop_start : 0, loop_source.active ? loop_end : 0);
+	            } else if (!want_pause && output_state != OUTPUT_RUNNING) {
+	                resume_output(sink, output_state);
+	                output_state = OUTPUT_RUNNING;
+	                pthread_mutex_lock(&control->mutex);
+	                control->resumes_done++;
+	                pthread_mutex_unlock(&control->mutex);
+	            }
+	            if (output_state != OUTPUT_RUNNING) {
+	                pthread_mutex_lock(&control->mutex);
+	                while (control->paused && !control->quit && !control->stop && !seek_pending(control) && !player_has_new_file(control))
+	                    pthread_cond_wait(&control->cond, &control->mutex);
+	                pthread_mutex_unlock(&control->mutex);
+	                continue;
+	            }
+            int ready = sink->ops->wait(sink, 100) > 0;
+            if (ready) {
+SAFE_MUTEX_LOCK(&control->mutex);
+perform_seek(control, sink);
+    if (seek_pending(control)) {
+        usleep(150000);
+        continue;
+    }
+pthread_mutex_unlock(&control->mutex);
+
+size_t read_size;
+		pthread_mutex_lock(&control->mutex);
+		loop_source_track(&loop_source, control, file);
+		int looping = loop_region(control, &loop_source, &loop_start, &loop_end);
+		if (control->is_silent) {
 		    memset(buffer, 0, buffer_size);
 		    read_size = buffer_size;
+		} else if (looping) {
+		    crossfade_cancel(&crossfade);
+		    if (control->loop_b_pending) loop_cut_at_b(control, sink, loop_start, loop_end);
+		    read_size = loop_fill(&loop_source, buffer, buffer_size, &control->bytes_read, loop_start, loop_end);
+		    loop_source.active = 1;
 		} else {
+		    if (loop_source.active) {
+		        fseek(file, control->bytes_read, SEEK_SET);
+		        loop_source.active = 0;
+		    }
+		    long long remaining = llround(control->duration * BYTES_PER_SECOND) - control->bytes_read;
+		    long long crossfade_bytes = crossfade_byte_count(control);
+		    if (crossfade.file && control->bytes_read != crossfade.out_pos) crossfade_cancel(&crossfade);
+		    if (!crossfade.file && crossfade_bytes > 0 && !control->fading_out && remaining > 0 && remaining < crossfade_bytes + buffer_size) {
+		        crossfade_begin(control, prefetch, &crossfade, remaining);
+		    }
+		    uint64_t read_begin = monotonic_us();
 		    read_size = fread(buffer, 1, buffer_size, file);
+		    histogram_record(&audio_stats.read, (unsigned long)(monotonic_us() - read_begin));
 		    if (read_size % 4 != 0) {
 		        read_size -= read_size % 4;
 		        if (read_size < 0) read_size = 0;
 		    }
+	if (crossfade.file) {
+	    control->bytes_read += (long long)read_size;
+	    int short_read = (int)read_size < buffer_size;
+	    read_size = crossfade_mix(&crossfade, buffer, incoming, (int)read_size, buffer_size);
+	    if (crossfade.done >= crossfade.frames || short_read) crossfade_commit(control, &crossfade, &file);
+	    else crossfade.out_pos = control->bytes_read;
+	} else {
 	if (read_size == 0) {
     if (feof(file)) {
-        if (control->playlist_mode && control->current_track < control->playlist_size - 1) {
-            safe_cleanup_resources(&file, &handle, &poll_fds, &control->current_filename);
-            control->current_track++;
-            control->filename = SAFE_STRDUP(control->playlist[control->current_track]);
-            if (!control->filename) {
-                control->current_track = control->playlist_size;
+        int next_pos = 0;
+        int next_track = -1;
+        char *next_path = queue_pop(control);
+        if (!next_path && control->playlist_mode) {
+            next_track = playlist_next_track(control, &next_pos);
+            if (next_track >= 0) next_path = playlist_track_dup(control->playlist, next_track);
+        }
+        if (next_path) {
+            crossfade_cancel(&crossfade);
+            long long next_size = 0;
+            FILE *next_file = prefetch_take(prefetch, next_path, &next_size);
+            if (next_track >= 0) {
+                control->current_track = next_track;
+                control->order_pos = next_pos;
+            } else {
+                control->loop_mode = 0;
+            }
+            SAFE_FREE(control->filename);
+            control->filename = next_path;
+            if (next_file) {
+                fclose(file);
+                file = next_file;
+                control->current_file = file;
+                assign_safe_strdup(&control->current_filename, next_path);
+                control->track_starts++;
+                trace_event("track open", 'i', (long)control->track_starts);
+                control->duration = (double)next_size / BYTES_PER_SECOND;
+                control->bytes_read = 0LL;
+                control->end_fade_from = 0;
+                track_event_start(control);
+            } else {
+                safe_cleanup_resources(&file, NULL, &control->current_filename);
+                control->current_file = NULL;
+                control->delay_frames = 0;
+                track_event_finish();
+                drain_next = 1;
             }
             pthread_mutex_unlock(&control->mutex);
             continue;
+        } else if (control->playlist_mode && control->playlist_loading) {
+            pthread_cond_wait(&control->cond, &control->mutex);
+            pthread_mutex_unlock(&control->mutex);
+            continue;
         } else if (control->loop_mode && !control->playlist_mode) {
             fseek(file, 0, SEEK_SET);
             control->bytes_read = 0LL;
             control->seek_delta = 0;
+            control->seek_target = -1;
             pthread_mutex_unlock(&control->mutex);
             continue;
         } else {
@@ -1528,28 +3572,29 @@ size_t read_size;
                 display_message(STATUS, "End of playlist reached");
             }
             if (control->playlist) {
-                free_names(control->playlist, control->playlist_size, 0);
-                control->playlist = NULL;
+                SAFE_FREE(control->playlist);
                 control->playlist_size = 0;
-                control->playlist_capacity = 0;
                 free(control->playlist_dir);
                 control->playlist_dir = NULL;
             }
             SAFE_FREE(control->filename);
-            safe_cleanup_resources(&file, &handle, &poll_fds, &control->current_filename);
+            safe_cleanup_resources(&file, NULL, &control->current_filename);
+            control->current_file = NULL;
+            control->delay_frames = 0;
+            track_event_finish();
             control->playlist_mode = 0;
             control->duration = 0.0;
             control->bytes_read = 0LL;
+            control->level_peak = 0;
+            control->level_rms = 0.0;
             pthread_mutex_unlock(&control->mutex);
             continue;
         }
     } else {
         display_message(ERROR, "File read error");
         if (control->playlist) {
-            free_names(control->playlist, control->playlist_size, 0);
-            control->playlist = NULL;
+            SAFE_FREE(control->playlist);
             control->playlist_size = 0;
-            control->playlist_capacity = 0;
             free(control->playlist_dir);
             control->playlist_dir = NULL;
         }
@@ -1557,7 +3602,11 @@ size_t read_size;
             free(control->filename);
             control->filename = NULL;
         }
-        safe_cleanup_resources(&file, &handle, &poll_fds, &control->current_filename);
+        safe_cleanup_resources(&file, NULL, &control->current_filename);
+        control->current_file = NULL;
+        control->delay_frames = 0;
+        track_event_finish();
+        if (sink) sink->ops->drop(sink);
         cleanup_playlist_and_filename(control);
         control->playlist_mode = 0;
         control->duration = 0.0;
@@ -1568,6 +3617,7 @@ size_t read_size;
 }
 
 control->bytes_read += (long long)read_size;
+	}
 }
 pthread_mutex_unlock(&control->mutex);
 	int actual_size = (read_size / 4) * 4;
@@ -1577,29 +3627,78 @@ pthread_mutex_unlock(&control->mutex);
 	    int dir = control->fading_out ? -1 : 1;
 	    apply_fade(control, dir, buffer, actual_size);
 	}
+	if (!crossfade.file) apply_end_fade(control, buffer, actual_size);
+	uint64_t sum_squares;
+	kernels.peak_rms_s16((const int16_t *)buffer, actual_size / 2, &control->level_peak, &sum_squares);
+	control->level_rms = sqrt((double)sum_squares / (actual_size / 2));
+pthread_mutex_unlock(&control->mutex);
+uint64_t write_begin = monotonic_us();
+trace_event("sink write", 'B', actual_size / FRAME_SIZE);
+sink->ops->write(sink, buffer, actual_size / FRAME_SIZE);
+trace_event("sink write", 'E', 0);
+uint64_t write_end = monotonic_us();
+histogram_record(&audio_stats.write, (unsigned long)(write_end - write_begin));
+long delay = sink->ops->delay(sink);
+if (sink->clocked && paced_iteration == iteration - 1 && labs(delay - paced_delay) < actual_size / FRAME_SIZE / 2) {
+    long long late = (long long)(write_end - paced_us) - paced_period_us;
+    histogram_record(&audio_stats.wakeup_jitter, (unsigned long)llabs(late));
+}
+paced_iteration = iteration;
+paced_us = write_end;
+paced_period_us = (long long)(actual_size / FRAME_SIZE) * 1000000 / RATE;
+paced_delay = delay;
+histogram_record(&audio_stats.fill, (unsigned long)((long long)delay * 1000000 / RATE));
+pthread_mutex_lock(&control->mutex);
+control->delay_frames = delay;
+latency_probe_check(control, delay, actual_size / FRAME_SIZE);
 pthread_mutex_unlock(&control->mutex);
-play_audio(handle, buffer, actual_size);
+if (first_write_pending) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double ms = (now.tv_sec - start_requested.tv_sec) * 1000.0 + (now.tv_nsec - start_requested.tv_nsec) / 1e6;
+    pthread_mutex_lock(&control->mutex);
+    control->ttfs_last_ms = ms;
+    control->ttfs_total_ms += ms;
+    control->ttfs_count++;
+    pthread_mutex_unlock(&control->mutex);
+    first_write_pending = 0;
+}
+prefetch_upcoming(control, prefetch);
             }
         } else {
-            usleep(100000);
+            pthread_mutex_lock(&control->mutex);
+            if (!control->quit && !control->stop && !player_has_new_file(control))
+                pthread_cond_wait(&control->cond, &control->mutex);
+            pthread_mutex_unlock(&control->mutex);
         }
     }
-    safe_cleanup_resources(&file, &handle, &poll_fds, &control->current_filename);
+    crossfade_cancel(&crossfade);
+    loop_source_release(&loop_source);
+    safe_cleanup_resources(&file, &sink, &control->current_filename);
+    control->current_file = NULL;
+    control->delay_frames = 0;
+    prefetch_release_all(prefetch);
+    if (control->handoff_file) {
+        fclose(control->handoff_file);
+        control->handoff_file = NULL;
+    }
+    SAFE_FREE(control->handoff_path);
     cleanup_playlist_and_filename(control);
     return NULL;
 }
 
-void perform_seek(PlayerControl *control, snd_pcm_t *handle)
+void perform_seek(PlayerControl *control, OutputSink *sink)
 {
-    if (!control->current_file || control->seek_delta == 0) {
+    if (!control->current_file || !seek_pending(control)) {
         control->seek_delta = 0;
+        control->seek_target = -1;
         return;
     }
-    long long seek_bytes = (long long)control->seek_delta * BYTES_PER_SECOND;
     pthread_mutex_lock(&control->mutex);
-    long current_pos = ftell(control->current_file);
+    long long current_pos = control->bytes_read;
     pthread_mutex_unlock(&control->mutex);
-    long long new_pos = current_pos + seek_bytes;
+    long long new_pos = control->seek_target >= 0 ? control->seek_target
+                                                  : current_pos + (long long)control->seek_delta * BYTES_PER_SECOND;
     long file_size = 0;
     pthread_mutex_lock(&control->mutex);
     long original_pos = ftell(control->current_file);
@@ -1613,23 +3712,24 @@ void perform_seek(PlayerControl *control, snd_pcm_t *handle)
     new_pos = (new_pos / 4) * 4;
     if (new_pos == current_pos) {
         control->seek_delta = 0;
+        control->seek_target = -1;
         return;
     }
-    if (handle && !control->is_silent) {
+    trace_event("seek", 'B', (long)(new_pos / FRAME_SIZE));
+    if (sink && !control->is_silent) {
         control->fading_out = 1;
-        control->current_fade = FADE_STEPS;
+        control->current_fade = FADE_FRAMES;
         usleep(50000);
     }
     pthread_mutex_lock(&control->mutex);
     fseek(control->current_file, new_pos, SEEK_SET);
     control->bytes_read = new_pos;
-    if (handle) {
-        snd_pcm_drop(handle);
-        snd_pcm_prepare(handle);
+    if (sink) {
+        sink->ops->drop(sink);
         char silence_buffer[8192];
         memset(silence_buffer, 0, sizeof(silence_buffer));
         for (int i = 0; i < 3; i++) {
-            snd_pcm_writei(handle, silence_buffer, sizeof(silence_buffer) / FRAME_SIZE);
+            sink->ops->write(sink, silence_buffer, sizeof(silence_buffer) / FRAME_SIZE);
         }
     }
     control->fading_out = 0;
@@ -1637,8 +3737,11 @@ void perform_seek(PlayerControl *control, snd_pcm_t *handle)
     control->current_fade = 0;
     control->is_silent = 0;
     control->seek_delta = 0;
+    control->seek_target = -1;
+    control->seeks_done++;
     pthread_mutex_unlock(&control->mutex);
     usleep(100000);
+    trace_event("seek", 'E', 0);
 }
 
 static const char *get_basename(const char *path) {
@@ -1660,529 +3763,2554 @@ free(w_b);
 return res;
 }
 
-static int load_raw_files(const char *dir_path, char ***files_out, int *count_out) {
+static int load_raw_files(const char *dir_path, Playlist **playlist_out) {
     void *entries = NULL;
-    if (scan_directory(dir_path, 1, &entries, count_out, 1) != 0) return -1;
-    if (*count_out == 0) {
+    int count = 0;
+    *playlist_out = NULL;
+    if (scan_directory(dir_path, 1, &entries, &count, 1) != 0) return -1;
+    if (count == 0) {
         free(entries);
         return 0;
     }
-    if (entries && *count_out > 0) {
     setlocale(LC_COLLATE, "");
-    qsort(entries, *count_out, sizeof(char *), playlist_cmp);
+    qsort(entries, count, sizeof(char *), playlist_cmp);
+    PlaylistBuilder builder = {0};
+    char **paths = (char **)entries;
+    for (int i = 0; i < count; i++) {
+        if (playlist_builder_add_path(&builder, paths[i]) != 0) {
+            free_names(entries, count, 0);
+            playlist_builder_free(&builder);
+            memory_error();
+            return -1;
+        }
     }
-    *files_out = (char **)entries;
+    free_names(entries, count, 0);
+    *playlist_out = playlist_builder_finish(&builder);
     return 0;
 }
 
-void load_playlist(const char *dir_path, PlayerControl *control) {
-with_mutex(control, action_set_stop_playlist, NULL, 1);
-    usleep(100000);
-    show_error = 0;
-    error_msg[0] = '\0';
-with_mutex(control, action_set_stop, NULL, 1);
-struct LoadMainData data = {dir_path};
-with_mutex(control, action_load_main, &data, 0);
-}
+typedef struct WalkDir {
+    DIR *dir;
+    atomic_int refs;
+} WalkDir;
 
-void shutdown_player_thread(PlayerControl *control, pthread_t thread, int *have_player_thread) {
-    if (!*have_player_thread) return;
-    lock_and_signal(control, NULL);
-    control->quit = 1;
-    int has_active_file = 0;
-SAFE_MUTEX_LOCK(&control->mutex);
-    has_active_file = (control->current_filename != NULL);
-    pthread_mutex_unlock(&control->mutex);
-if (has_active_file) {
-        int joined = 0;
-        time_t start = time(NULL);
-        while (!joined && (time(NULL) - start < 3)) {
-            int kill_ret = pthread_kill(thread, 0);
-            if (kill_ret == ESRCH) {
-                joined = 1;
-            } else if (kill_ret == 0) {
-                usleep(100000);
-            }
+typedef struct WalkTask {
+    char *rel;
+    WalkDir *parent;
+    void *node;
+} WalkTask;
+
+typedef struct WalkDeque {
+    pthread_mutex_t lock;
+    WalkTask *tasks;
+    size_t head;
+    size_t count;
+    size_t capacity;
+} WalkDeque;
+
+typedef struct TreeWalk TreeWalk;
+typedef void (*walk_visit_fn)(TreeWalk *walk, int worker, WalkTask *task, DIR *dir);
+
+typedef struct WalkWorker {
+    TreeWalk *walk;
+    int index;
+    pthread_t thread;
+    WalkDeque deque;
+    WalkDir *current;
+    atomic_long entries;
+    char pad[64];
+} WalkWorker;
+
+struct TreeWalk {
+    int root_fd;
+    int worker_count;
+    int thread_count;
+    WalkWorker workers[WALK_MAX_THREADS];
+    atomic_long pending;
+    atomic_int cancel;
+    atomic_int running;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+    walk_visit_fn visit;
+    void *user;
+    struct timespec started;
+    struct timespec finished;
+};
+
+static int walk_deque_push(WalkDeque *dq, WalkTask task) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count == dq->capacity) {
+        size_t new_capacity = dq->capacity ? dq->capacity * 2 : WALK_DEQUE_INIT;
+        WalkTask *grown = malloc(new_capacity * sizeof(WalkTask));
+        if (!grown) {
+            pthread_mutex_unlock(&dq->lock);
+            return -1;
         }
-        if (!joined) {
-            pthread_detach(thread);
-            fflush(stderr);
+        for (size_t i = 0; i < dq->count; i++) {
+            grown[i] = dq->tasks[(dq->head + i) % dq->capacity];
         }
-    } else {
-        pthread_join(thread, NULL);
+        free(dq->tasks);
+        dq->tasks = grown;
+        dq->head = 0;
+        dq->capacity = new_capacity;
     }
+    dq->tasks[(dq->head + dq->count) % dq->capacity] = task;
+    dq->count++;
+    pthread_mutex_unlock(&dq->lock);
+    return 0;
 }
 
-void action_p(PlayerControl *control)
-{
-    if (!control->current_file) {
-        display_message(STATUS, "Nothing to pause");
-        return;
+static int walk_deque_take(WalkDeque *dq, WalkTask *out, int steal) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count == 0) {
+        pthread_mutex_unlock(&dq->lock);
+        return 0;
     }
-    if (control->paused) {
-        control->paused = 0;
-        control->is_silent = 0;
-        control->fading_in = 1;
-        control->current_fade = 0;
-        control->fading_out = 0;//
-        display_message(STATUS, "RESUMED (smooth fade-in)");
+    if (steal) {
+        *out = dq->tasks[dq->head];
+        dq->head = (dq->head + 1) % dq->capacity;
     } else {
-        control->paused = 1;
-        control->fading_out = 1;
-        control->current_fade = FADE_STEPS;
-        display_message(STATUS, "PAUSED (smooth fade-out)");
+        *out = dq->tasks[(dq->head + dq->count - 1) % dq->capacity];
     }
+    dq->count--;
+    pthread_mutex_unlock(&dq->lock);
+    return 1;
 }
 
-void action_seek(PlayerControl *control, int delta, const char *msg_if_none) {
-    if (control->current_file) {
-        control->seek_delta = delta;
-    } else {
-        display_message(STATUS, "%s", msg_if_none);
-    }
+static char *walk_join_path(const char *parent_rel, const char *name) {
+    if (!parent_rel || parent_rel[0] == '\0') return safe_strdup(name);
+    return xasprintf("%s/%s", parent_rel, name);
 }
 
-static void fade_in_on_start(void) {
-    SAFE_MUTEX_LOCK(&player_control.mutex);
-    player_control.fading_out = 0;
-    player_control.fading_in = 0;
-    player_control.current_fade = 0;
-    player_control.is_silent = 0;
-    pthread_mutex_unlock(&player_control.mutex);
-    usleep(50000);
-    SAFE_MUTEX_LOCK(&player_control.mutex);
-    player_control.fading_in = 1;
-    player_control.current_fade = 0;
-    pthread_cond_signal(&player_control.cond);
-    pthread_mutex_unlock(&player_control.mutex);
+static int walk_entry_type(int dir_fd, const struct dirent *entry) {
+    if (entry->d_type != DT_UNKNOWN) return entry->d_type;
+    struct stat st;
+    if (fstatat(dir_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) return DT_UNKNOWN;
+    if (S_ISDIR(st.st_mode)) return DT_DIR;
+    if (S_ISREG(st.st_mode)) return DT_REG;
+    if (S_ISLNK(st.st_mode)) return DT_LNK;
+    return DT_UNKNOWN;
 }
 
-static void play_single_file(void) {
-    if (!next_file_to_play || !next_file_name_to_play) {
-        display_message(ERROR, "No file to play");
-        return;
+static void walk_dir_release(WalkDir *dir) {
+    if (!dir || atomic_fetch_sub(&dir->refs, 1) != 1) return;
+    closedir(dir->dir);
+    free(dir);
+}
+
+static DIR *walk_open_task(TreeWalk *walk, WalkTask *task) {
+    int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+    int fd;
+    if (task->parent) {
+        const char *slash = strrchr(task->rel, '/');
+        fd = openat(dirfd(task->parent->dir), slash ? slash + 1 : task->rel, flags);
+    } else {
+        fd = openat(walk->root_fd, ".", flags);
     }
-    SAFE_MUTEX_LOCK(&player_control.mutex);
-    SAFE_FREE(player_control.filename);
-    player_control.filename = strdup(next_file_to_play);
-    SAFE_FREE(player_control.current_filename);
-    player_control.current_filename = strdup(next_file_name_to_play);
-    player_control.stop = 0;
-    player_control.paused = 0;
-    pthread_cond_signal(&player_control.cond);
-    pthread_mutex_unlock(&player_control.mutex);
-    SAFE_FREE(next_file_to_play);
-    SAFE_FREE(next_file_name_to_play);
+    DIR *dir = (fd == -1) ? NULL : fdopendir(fd);
+    if (!dir && fd != -1) close(fd);
+    return dir;
 }
 
-void action_next_prev(PlayerControl *control, int direction) {
-    (void)control;
-    if (file_count == 0) return;
-    const char *current_full_path = NULL;
-    const char *current_playing = NULL;
-    SAFE_MUTEX_LOCK(&player_control.mutex);
-    if (player_control.current_filename) {
-        current_full_path = player_control.current_filename;
-        const char *slash = strrchr(current_full_path, '/');
-        current_playing = slash ? slash + 1 : current_full_path;
+static int walk_push(TreeWalk *walk, int worker, char *rel, void *node) {
+    WalkTask task = { rel, walk->workers[worker].current, node };
+    if (task.parent) atomic_fetch_add(&task.parent->refs, 1);
+    atomic_fetch_add(&walk->pending, 1);
+    if (walk_deque_push(&walk->workers[worker].deque, task) != 0) {
+        atomic_fetch_sub(&walk->pending, 1);
+        walk_dir_release(task.parent);
+        free(rel);
+        return -1;
     }
-    pthread_mutex_unlock(&player_control.mutex);
-    if (!current_playing) {
-        display_message(ERROR, "Nothing is playing");
-        return;
-    }
-    int playing_idx = -1;
-    for (int i = 0; i < file_count; i++) {
-        if (file_list[i].name && !file_list[i].is_dir &&
-            strcmp(file_list[i].name, current_playing) == 0) {
-            playing_idx = i;
-            break;
+    pthread_mutex_lock(&walk->idle_lock);
+    pthread_cond_signal(&walk->idle_cond);
+    pthread_mutex_unlock(&walk->idle_lock);
+    return 0;
+}
+
+static void *walk_worker(void *arg) {
+    WalkWorker *self = (WalkWorker *)arg;
+    TreeWalk *walk = self->walk;
+    while (!atomic_load(&walk->cancel)) {
+        WalkTask task;
+        int have = walk_deque_take(&self->deque, &task, 0);
+        for (int i = 1; !have && i < walk->worker_count; i++) {
+            have = walk_deque_take(&walk->workers[(self->index + i) % walk->worker_count].deque, &task, 1);
         }
-    }
-    if (playing_idx == -1) {
-        display_message(ERROR, "Current file '%s' not found in list", current_playing);
-        return;
-    }
-    int next_idx = -1;
-    if (direction == 1) {
-        for (int i = playing_idx + 1; i < file_count; i++) {
-            if (!file_list[i].is_dir && is_raw_file(file_list[i].name)) {
-                next_idx = i;
-                break;
+        if (!have) {
+            if (atomic_load(&walk->pending) == 0) break;
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += 2000000;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
             }
-        }
-        if (next_idx == -1) {
-            for (int i = 0; i < file_count; i++) {
-                if (!file_list[i].is_dir && is_raw_file(file_list[i].name)) {
-                    next_idx = i;
-                    break;
-                }
+            pthread_mutex_lock(&walk->idle_lock);
+            if (atomic_load(&walk->pending) != 0) {
+                pthread_cond_timedwait(&walk->idle_cond, &walk->idle_lock, &ts);
             }
+            pthread_mutex_unlock(&walk->idle_lock);
+            continue;
         }
-    } else {
-        for (int i = playing_idx - 1; i >= 0; i--) {
-            if (!file_list[i].is_dir && is_raw_file(file_list[i].name)) {
-                next_idx = i;
-                break;
-            }
+        DIR *dir = walk_open_task(walk, &task);
+        walk_dir_release(task.parent);
+        WalkDir *current = dir ? malloc(sizeof(WalkDir)) : NULL;
+        if (current) {
+            current->dir = dir;
+            atomic_init(&current->refs, 1);
+        } else if (dir) {
+            closedir(dir);
+            dir = NULL;
         }
-        if (next_idx == -1) {
-            for (int i = file_count - 1; i >= 0; i--) {
-                if (!file_list[i].is_dir && is_raw_file(file_list[i].name)) {
-                    next_idx = i;
-                    break;
-                }
-            }
+        self->current = current;
+        walk->visit(walk, self->index, &task, dir);
+        self->current = NULL;
+        walk_dir_release(current);
+        free(task.rel);
+        if (atomic_fetch_sub(&walk->pending, 1) == 1) {
+            pthread_mutex_lock(&walk->idle_lock);
+            pthread_cond_broadcast(&walk->idle_cond);
+            pthread_mutex_unlock(&walk->idle_lock);
         }
     }
-    if (next_idx == -1) {
-        display_message(ERROR, "No more .raw files");
-        return;
+    if (atomic_fetch_sub(&walk->running, 1) == 1) {
+        clock_gettime(CLOCK_MONOTONIC, &walk->finished);
     }
-    lock_and_signal(&player_control, action_s);
-    usleep(80000);
-    char *full_path = xasprintf("%s/%s", current_dir, file_list[next_idx].name);
-    if (!full_path) {
-        display_message(ERROR, "Out of memory");
-        return;
+    return NULL;
+}
+
+static int io_worker_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int count = (cpus > 0) ? (int)cpus * 2 : 2;
+    if (count < 2) count = 2;
+    if (count > WALK_MAX_THREADS) count = WALK_MAX_THREADS;
+    return count;
+}
+
+static void tree_walk_destroy(TreeWalk *walk) {
+    if (!walk) return;
+    atomic_store(&walk->cancel, 1);
+    for (int i = 0; i < walk->thread_count; i++) {
+        pthread_join(walk->workers[i].thread, NULL);
     }
-    SAFE_FREE(next_file_to_play);
-    SAFE_FREE(next_file_name_to_play);
-    next_file_to_play = strdup(full_path);
-    next_file_name_to_play = strdup(file_list[next_idx].name);
-    free(full_path);
-    if (!next_file_to_play || !next_file_name_to_play) {
-        SAFE_FREE(next_file_to_play);
-        SAFE_FREE(next_file_name_to_play);
-        display_message(ERROR, "Out of memory");
-        return;
+    for (int i = 0; i < walk->worker_count; i++) {
+        WalkDeque *dq = &walk->workers[i].deque;
+        for (size_t j = 0; j < dq->count; j++) {
+            WalkTask *task = &dq->tasks[(dq->head + j) % dq->capacity];
+            walk_dir_release(task->parent);
+            free(task->rel);
+        }
+        free(dq->tasks);
+        pthread_mutex_destroy(&dq->lock);
     }
-    fade_in_on_start();
-    play_single_file();
-    display_message(STATUS, "%s: %s", direction == 1 ? "Next" : "Previous", file_list[next_idx].name);
+    close(walk->root_fd);
+    pthread_mutex_destroy(&walk->idle_lock);
+    pthread_cond_destroy(&walk->idle_cond);
+    free(walk);
 }
 
-void action_s(PlayerControl *control) {
-    if (control->current_file && control->current_filename && !control->paused) {
-        control->fading_out = 1;
-        control->current_fade = FADE_STEPS;
-        control->is_silent = 0;
-        control->stop = 0;
-        display_message(STATUS, "Fading before stopping...");
-    } else {
-        control->stop = 1;
-        control->duration = 0.0;
-        control->bytes_read = 0LL;
-        show_error = 0;
-        error_msg[0] = '\0';
-        if (control->current_filename) {
-            free(control->current_filename);
-            control->current_filename = NULL;
+static TreeWalk *tree_walk_start(const char *root_path, walk_visit_fn visit, void *user, void *root_node) {
+    TreeWalk *walk = calloc(1, sizeof(TreeWalk));
+    if (!walk) {
+        memory_error();
+        return NULL;
+    }
+    walk->root_fd = open(root_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (walk->root_fd == -1) {
+        display_message(ERROR, ACCESS_DENIED_MSG, root_path);
+        free(walk);
+        return NULL;
+    }
+    walk->visit = visit;
+    walk->user = user;
+    pthread_mutex_init(&walk->idle_lock, NULL);
+    pthread_cond_init(&walk->idle_cond, NULL);
+    int count = io_worker_count();
+    walk->worker_count = count;
+    for (int i = 0; i < count; i++) {
+        walk->workers[i].walk = walk;
+        walk->workers[i].index = i;
+        pthread_mutex_init(&walk->workers[i].deque.lock, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &walk->started);
+    char *root_rel = safe_strdup("");
+    if (!root_rel || walk_push(walk, 0, root_rel, root_node) != 0) {
+        tree_walk_destroy(walk);
+        return NULL;
+    }
+    atomic_store(&walk->running, count);
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&walk->workers[i].thread, NULL, walk_worker, &walk->workers[i]) != 0) {
+            atomic_fetch_sub(&walk->running, count - i);
+            break;
         }
-        control->paused = 0;
-        control->fading_out = 0;
-        cleanup_playlist(control);
-        control->playlist_mode = 0;
-        control->current_track = 0;
-        display_message(STATUS, "Playback stopped");
+        walk->thread_count++;
+    }
+    if (walk->thread_count == 0) {
+        display_message(ERROR, "pthread_create failed — scan disabled");
+        tree_walk_destroy(walk);
+        return NULL;
     }
+    return walk;
 }
 
-void lock_and_signal(PlayerControl *control, void (*action)(PlayerControl *)) {
-    pthread_mutex_lock(&control->mutex);
-    if (action) action(control);
-    pthread_cond_signal(&control->cond);
-    pthread_mutex_unlock(&control->mutex);
+static void tree_walk_join(TreeWalk *walk) {
+    for (int i = 0; i < walk->thread_count; i++) {
+        pthread_join(walk->workers[i].thread, NULL);
+    }
+    walk->thread_count = 0;
 }
 
-void lock_and_signal_seek(PlayerControl *control, int delta, const char *msg) {
-    SAFE_MUTEX_LOCK(&player_control.mutex);
-    action_seek(control, delta, msg);
-    pthread_cond_signal(&control->cond);
-    pthread_mutex_unlock(&control->mutex);
+static int tree_walk_finished(TreeWalk *walk) {
+    return atomic_load(&walk->running) == 0;
 }
 
-static void start_playback(const char *full_path, const char *file_name, int enable_loop) {
-    if (!full_path || !file_name) return;
-    show_error = 0;
-    error_msg[0] = '\0';
-    struct stat st;
-    if (stat(full_path, &st) == 0) {
-        if (st.st_size == 0) {
-            display_message(ERROR, "File '%s' is empty (0 bytes)", file_name);
+static long tree_walk_entries(TreeWalk *walk) {
+    long total = 0;
+    for (int i = 0; i < walk->worker_count; i++) {
+        total += atomic_load_explicit(&walk->workers[i].entries, memory_order_relaxed);
+    }
+    return total;
+}
+
+static double tree_walk_elapsed(TreeWalk *walk) {
+    struct timespec now;
+    if (tree_walk_finished(walk)) {
+        now = walk->finished;
+    } else {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    }
+    return (double)(now.tv_sec - walk->started.tv_sec) + (now.tv_nsec - walk->started.tv_nsec) / 1e9;
+}
+
+typedef struct SearchState {
+    TreeWalk *walk;
+    pthread_mutex_t lock;
+    char **results;
+    int count;
+    int capacity;
+    int selected;
+    int reported_done;
+    char pattern[NAME_MAX + 1];
+    char root[PATH_MAX];
+} SearchState;
+
+static SearchState search_state = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static int search_mode = 0;
+
+static void search_add_result(SearchState *s, char *rel) {
+    if (!rel) return;
+    pthread_mutex_lock(&s->lock);
+    if (s->count >= s->capacity) {
+        int new_capacity = s->capacity ? s->capacity * 2 : 64;
+        char **grown = realloc(s->results, new_capacity * sizeof(char *));
+        if (!grown) {
+            pthread_mutex_unlock(&s->lock);
+            free(rel);
             return;
         }
-        if (st.st_size < 4) {
-            display_message(ERROR, "File '%s' too small for a single frame (%ld bytes < 4)", file_name, st.st_size);
-            return;
+        s->results = grown;
+        s->capacity = new_capacity;
+    }
+    s->results[s->count++] = rel;
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void search_visit(TreeWalk *walk, int worker, WalkTask *task, DIR *dir) {
+    if (!dir) return;
+    SearchState *s = (SearchState *)walk->user;
+    WalkWorker *self = &walk->workers[worker];
+    int dir_fd = dirfd(dir);
+    struct dirent *entry;
+    while (!atomic_load_explicit(&walk->cancel, memory_order_relaxed) && (entry = readdir(dir))) {
+        if (should_skip_entry(entry, 0)) continue;
+        atomic_fetch_add_explicit(&self->entries, 1, memory_order_relaxed);
+        int type = walk_entry_type(dir_fd, entry);
+        if (type == DT_DIR) {
+            char *rel = walk_join_path(task->rel, entry->d_name);
+            if (rel) walk_push(walk, worker, rel, NULL);
+        } else if (type == DT_REG && is_raw_file(entry->d_name) &&
+                   strcasestr(entry->d_name, s->pattern)) {
+            search_add_result(s, walk_join_path(task->rel, entry->d_name));
         }
-        if (st.st_size % 4 != 0) {
-            display_message(ERROR,
-                "File '%s': size %ld bytes not multiple of 4. "
-                "Required: stereo 16-bit RAW (2ch × 2bytes = 4bytes/frame)",
-                file_name, st.st_size);
-            return;
+    }
+}
+
+static void search_clear(void) {
+    tree_walk_destroy(search_state.walk);
+    search_state.walk = NULL;
+    free_names(search_state.results, search_state.count, 0);
+    search_state.results = NULL;
+    search_state.count = 0;
+    search_state.capacity = 0;
+    search_state.selected = 0;
+    search_state.reported_done = 0;
+}
+
+static void search_start(const char *pattern) {
+    search_clear();
+    SAFE_STRNCPY(search_state.pattern, pattern, sizeof(search_state.pattern));
+    SAFE_STRNCPY(search_state.root, current_dir, sizeof(search_state.root));
+    search_state.walk = tree_walk_start(search_state.root, search_visit, &search_state, NULL);
+    search_mode = (search_state.walk != NULL);
+}
+
+static void search_update_status(void) {
+    TreeWalk *walk = search_state.walk;
+    if (!walk || search_state.reported_done) return;
+    int finished = tree_walk_finished(walk);
+    long entries = tree_walk_entries(walk);
+    double elapsed = tree_walk_elapsed(walk);
+    pthread_mutex_lock(&search_state.lock);
+    int found = search_state.count;
+    pthread_mutex_unlock(&search_state.lock);
+    const char *state = "Searching";
+    if (finished) state = atomic_load(&walk->cancel) ? "Search cancelled" : "Search done";
+    display_message(STATUS, "%s '%s': %d found | %ld entries | %.0f entries/s",
+                    state, search_state.pattern, found, entries,
+                    elapsed > 0.0 ? entries / elapsed : 0.0);
+    search_state.reported_done = finished;
+}
+
+static int prompt_input(WINDOW *win, const char *title, char *buf, size_t size) {
+    wchar_t wbuf[NAME_MAX + 1] = {0};
+    size_t wlen = mbstowcs(wbuf, buf, NAME_MAX);
+    if (wlen == (size_t)-1) wlen = 0;
+    wbuf[wlen] = L'\0';
+    int max_y, max_x;
+    getmaxyx(win, max_y, max_x);
+    int actual_width = (max_x < FILE_LIST_FIXED_WIDTH) ? max_x : FILE_LIST_FIXED_WIDTH;
+    int field_y = max_y - 3;
+    int result = -1;
+    wtimeout(win, -1);
+    curs_set(1);
+    while (1) {
+        clear_rect(win, field_y, max_y, 0, actual_width);
+        draw_single_frame(win, field_y, 3, title, 0);
+        const wchar_t *visible = wbuf;
+        while (*visible && wcswidth(visible, wcslen(visible)) > actual_width - 5) visible++;
+        mvwaddwstr(win, field_y + 1, 2, visible);
+        wrefresh(win);
+        wint_t wch;
+        int kind = wget_wch(win, &wch);
+        if (kind == ERR) continue;
+        if (kind == KEY_CODE_YES) {
+            if (wch == KEY_ENTER) {
+                result = 0;
+                break;
+            }
+            if (wch == KEY_BACKSPACE && wlen > 0) wbuf[--wlen] = L'\0';
+            continue;
         }
-        if (st.st_size < 1024) {
-            display_message(STATUS,
-                "File '%s' is very small (%ld bytes). Playback may be short.",
-                file_name, st.st_size);
+        if (wch == L'\n' || wch == L'\r') {
+            result = 0;
+            break;
+        }
+        if (wch == 27) break;
+        if (wch == 127 || wch == 8) {
+            if (wlen > 0) wbuf[--wlen] = L'\0';
+        } else if (iswprint(wch) && wlen < NAME_MAX) {
+            wbuf[wlen++] = (wchar_t)wch;
+            wbuf[wlen] = L'\0';
         }
-    } else {
-        display_message(ERROR, "Cannot access file: %s", file_name);
-        return;
     }
-    FILE *temp_file = fopen(full_path, "rb");
-    if (!temp_file) {
-        display_message(ERROR, "Failed to open for validation: %s", file_name);
-        return;
+    curs_set(0);
+    wtimeout(win, 50);
+    if (result == 0) {
+        size_t n = wcstombs(buf, wbuf, size);
+        if (n == (size_t)-1 || n >= size) return -1;
     }
-    char header[4] = {0};
-    size_t read = fread(header, 1, 4, temp_file);
-    fclose(temp_file);
-    if (read >= 4) {
-        if (memcmp(header, "RIFF", 4) == 0 || memcmp(header, "OggS", 4) == 0 ||
-            memcmp(header, "fLaC", 4) == 0 || memcmp(header, "FORM", 4) == 0) {
-            display_message(ERROR, "File '%s' appears to be formatted audio (e.g., WAV/OGG/FLAC/AIFF), not raw PCM", file_name);
-            return;
+    return result;
+}
+
+static void search_prompt_and_start(void) {
+    char pattern[NAME_MAX + 1] = "";
+    if (prompt_input(list_win, "SEARCH .raw BELOW CURRENT DIRECTORY", pattern, sizeof(pattern)) != 0) return;
+    search_start(pattern);
+}
+
+static void draw_search_results(WINDOW *win) {
+    if (!win) return;
+    werase(win);
+    top(win);
+    int max_y = getmaxy(win);
+    int usable_height = max_y - 6;
+    if (usable_height < 3) usable_height = 3;
+    char title[NAME_MAX + 16];
+    snprintf(title, sizeof(title), "SEARCH: %s", search_state.pattern[0] ? search_state.pattern : "*.raw");
+    draw_single_frame(win, 3, usable_height, title, 0);
+    int visible_lines = (max_y < 12) ? 1 : max_y - 8;
+    int cursor_end = 2 + CURSOR_WIDTH;
+    pthread_mutex_lock(&search_state.lock);
+    int count = search_state.count;
+    if (search_state.selected >= count) search_state.selected = count > 0 ? count - 1 : 0;
+    int start_index = 0;
+    if (count > visible_lines) {
+        start_index = search_state.selected - (visible_lines / 2);
+        if (start_index < 0) start_index = 0;
+        if (start_index > count - visible_lines) start_index = count - visible_lines;
+    }
+    int end_index = start_index + visible_lines;
+    if (end_index > count) end_index = count;
+    for (int i = start_index; i < end_index; i++) {
+        int row = i - start_index + 4;
+        wchar_t wname[CURSOR_WIDTH + 4] = {0};
+        prepare_display_wstring(search_state.results[i], CURSOR_WIDTH - 2, wname,
+                                sizeof(wname) / sizeof(wchar_t), 0, L"..", 0, 1);
+        int printed = wcswidth(wname, wcslen(wname));
+        if (printed < 0) printed = 0;
+        if (i == search_state.selected) {
+            wchar_t fill_ch = L'▒';
+            wattron(win, COLOR_PAIR(COLOR_PAIR_BORDER));
+            draw_fill_line(win, row, 2, cursor_end - 2, &fill_ch, 1, 1);
+            mvwaddwstr(win, row, 3, wname);
+            draw_fill_line(win, row, 3 + printed, cursor_end - (3 + printed), &fill_ch, 1, 1);
+            wattroff(win, COLOR_PAIR(COLOR_PAIR_BORDER));
+        } else {
+            wattron(win, COLOR_PAIR(3));
+            mvwaddwstr(win, row, 3, wname);
+            wattroff(win, COLOR_PAIR(3));
         }
     }
-    SAFE_FREE(next_file_to_play);
-    SAFE_FREE(next_file_name_to_play);
-    next_file_to_play = strdup(full_path);
-    next_file_name_to_play = strdup(file_name);
-    if (!next_file_to_play || !next_file_name_to_play) {
-        SAFE_FREE(next_file_to_play);
-        SAFE_FREE(next_file_name_to_play);
-        display_message(ERROR, "Out of memory! Cannot play file.");
-        return;
+    pthread_mutex_unlock(&search_state.lock);
+    if (count == 0) {
+        int finished = !search_state.walk || tree_walk_finished(search_state.walk);
+        mvwprintw(win, 4, 3, "%s", finished ? "No matches." : "Searching...");
     }
-    pthread_mutex_lock(&player_control.mutex);
-    cleanup_playlist(&player_control);
-    player_control.loop_mode = enable_loop;
-    player_control.paused = 0;
-    player_control.is_silent = 0;
-    player_control.fading_in = 0;
-    player_control.fading_out = 0;
-    player_control.current_fade = FADE_STEPS;
-    player_control.bytes_read = 0LL;
-    player_control.duration = 0.0;
-    player_control.seek_delta = 0;
-    pthread_cond_signal(&player_control.cond);
-    pthread_mutex_unlock(&player_control.mutex);
-    play_single_file();
-    fade_in_on_start();
-    if (enable_loop) {
-        display_message(STATUS, "Playback started in loop mode on new file");
+    draw_field_frame(win);
+}
+
+static void draw_main_view(WINDOW *win) {
+    trace_event("redraw", 'B', 0);
+    if (search_mode) {
+        draw_search_results(win);
     } else {
-        display_message(STATUS, "Playback started (smooth fade-in)");
+        draw_file_list(win);
     }
+    if (debug_overlay) draw_debug_overlay(win);
+    trace_event("redraw", 'E', 0);
 }
 
-int navigate_dir(const char *target_dir, char *status_buf)
-{
-    if (!target_dir || !status_buf) return -1;
-
-    if (chdir(target_dir) == 0) {
-        if (getcwd(current_dir, PATH_MAX) == NULL) {
-            display_message(ERROR, "getcwd failed - path may be too long");
-            return -1;
+static int handle_search_key(int ch) {
+    switch (ch) {
+    case KEY_UP:
+    case KEY_DOWN:
+        pthread_mutex_lock(&search_state.lock);
+        if (search_state.count > 0) {
+            if (ch == KEY_UP) {
+                search_state.selected = search_state.selected > 0 ? search_state.selected - 1 : search_state.count - 1;
+            } else {
+                search_state.selected = search_state.selected < search_state.count - 1 ? search_state.selected + 1 : 0;
+            }
         }
-        update_file_list();
-        status_buf[0] = '\0';
-        return 0;
-    } else {
-   display_message(ERROR, ACCESS_DENIED_MSG, target_dir);
-        return -1;
+        pthread_mutex_unlock(&search_state.lock);
+        return 1;
+    case 10: {
+        char *rel = NULL;
+        pthread_mutex_lock(&search_state.lock);
+        if (search_state.selected < search_state.count) rel = safe_strdup(search_state.results[search_state.selected]);
+        pthread_mutex_unlock(&search_state.lock);
+        if (!rel) return 1;
+        char *full_path = xasprintf("%s/%s", search_state.root, rel);
+        if (full_path) start_playback(full_path, get_basename(full_path), 0);
+        free(full_path);
+        free(rel);
+        return 1;
     }
+    case 27:
+        if (search_state.walk && !tree_walk_finished(search_state.walk)) {
+            atomic_store(&search_state.walk->cancel, 1);
+        } else {
+            search_clear();
+            search_mode = 0;
+        }
+        return 1;
+    case '/':
+        search_prompt_and_start();
+        return 1;
+    }
+    return 0;
 }
 
-int navigate_and_play(void) {
-    init_ncurses("en_US.UTF-8");
-    curs_set(0);
-    clearok(stdscr, TRUE);
-    idlok(stdscr, TRUE);
-    scrollok(stdscr, FALSE);
-    getmaxyx(stdscr, term_height, term_width);
-    draw_single_frame(stdscr, 0, term_height, "GRANNIK | COMPLEX SOFTWARE ECOSYSTEM | FILE NAVIGATOR RAW", 1);
-    wnoutrefresh(stdscr);
-    doupdate();
-
-    if (term_width < MIN_WIDTH || term_height < MIN_HEIGHT) {
-        endwin();
-        return -1;
+static int order_names(const char *a, const char *b) {
+    wchar_t *w_a = NULL, *w_b = NULL;
+    size_t len_a = 0, len_b = 0;
+    if (convert_to_wchar(a, &w_a, &len_a) != 0 || convert_to_wchar(b, &w_b, &len_b) != 0) {
+        free(w_a);
+        free(w_b);
+        return strcmp(a, b);
     }
-    list_win = newwin(term_height - 2, INNER_WIDTH, 1, 1);
-    if (!list_win) { endwin(); return -1; }
-	wtimeout(list_win, 50);
-	wtimeout(stdscr, 50);
-    keypad(list_win, TRUE);
+    int res = wcscoll(w_a, w_b);
+    free(w_a);
+    free(w_b);
+    return res ? res : strcmp(a, b);
+}
 
-    if (getcwd(current_dir, PATH_MAX) == NULL) {
-        delwin(list_win); endwin(); return -1;
-    }
-forward_history = malloc(forward_capacity * sizeof(char *));
-if (!forward_history) {
-fprintf(stderr, "Error: not enough memory for navigation history — function disabled\n");
-    forward_capacity = 0;
-    forward_count = 0;
-} else {
-    memset(forward_history, 0, forward_capacity * sizeof(char *));
+static int order_names_cmp(const void *a, const void *b) {
+    return order_names(*(const char **)a, *(const char **)b);
 }
-strncpy(root_dir, current_dir, sizeof(root_dir) - 2);
-root_dir[sizeof(root_dir) - 2] = '\0';
-if (root_dir[0] != '\0' && root_dir[strlen(root_dir) - 1] != '/') {
-    strcat(root_dir, "/");
+
+typedef struct ScanNode {
+    struct ScanNode *parent;
+    char *name;
+    char *rel;
+    int *rank_path;
+    int depth;
+    char **files;
+    int *file_ranks;
+    int file_count;
+    struct ScanNode **subdirs;
+    int subdir_count;
+    atomic_int scanned;
+    atomic_int empty;
+} ScanNode;
+
+typedef struct PlaylistInstall {
+    unsigned generation;
+    atomic_int started;
+    char dir[PATH_MAX];
+} PlaylistInstall;
+
+static void playlist_install_begin(PlaylistInstall *install, const char *dir) {
+    SAFE_STRNCPY(install->dir, dir, sizeof(install->dir));
+    atomic_store(&install->started, 0);
+    show_error = 0;
+    error_msg[0] = '\0';
+    SAFE_MUTEX_LOCK(&player_control.mutex);
+    action_set_stop_playlist(&player_control, NULL);
+    install->generation = ++player_control.playlist_generation;
+    pthread_cond_broadcast(&player_control.cond);
+    pthread_mutex_unlock(&player_control.mutex);
 }
-    free_forward_history();
-    update_file_list();
-    draw_file_list(list_win);
-    refresh();
-static int help_mode = 0;
-static int help_start_index = 0;
-int ch;
-	while (1) {
-	    ch = wgetch(list_win);
-if (help_mode) {
-    if (ch == KEY_SR || ch == KEY_UP) {
-        if (help_start_index > 0)
-            help_start_index--;
-        continue;
+
+static int playlist_install(PlaylistInstall *install, Playlist *playlist, int final) {
+    PlayerControl *control = &player_control;
+    int installed = 0;
+    SAFE_MUTEX_LOCK(&control->mutex);
+    while (control->stop == 1 && control->playlist_generation == install->generation) {
+        struct timespec ts_wait;
+        clock_gettime(CLOCK_REALTIME, &ts_wait);
+        ts_wait.tv_sec += 1;
+        if (pthread_cond_timedwait(&control->cond, &control->mutex, &ts_wait) == ETIMEDOUT) break;
     }
-    if (ch == KEY_SF || ch == KEY_DOWN) {
-        int max_y = getmaxy(list_win);
-        int visible_lines = max_y - 6;
-        int help_count = TOTAL_HELP_LINES;
-        if (help_start_index < help_count - visible_lines)
-            help_start_index++;
-        continue;
+    if (control->playlist_generation == install->generation) {
+        free(control->playlist);
+        control->playlist = playlist;
+        control->playlist_size = playlist->count;
+        if (atomic_load(&install->started)) {
+            if (control->shuffle_mode) playlist_shuffle(playlist, control->current_track);
+            control->order_pos = 0;
+        } else {
+            playlist_start_order(control);
+            control->playlist_mode = 1;
+            SAFE_FREE(control->filename);
+            control->filename = playlist_track_dup(playlist, control->current_track);
+            assign_safe_strdup(&control->playlist_dir, install->dir);
+            atomic_store(&install->started, 1);
+        }
+        control->playlist_loading = !final;
+        pthread_cond_broadcast(&control->cond);
+        installed = 1;
     }
-    if (ch == 'h' || ch == 'H') {
-        help_mode = 0;
-        continue;
+    pthread_mutex_unlock(&control->mutex);
+    if (!installed) free(playlist);
+    return installed;
+}
+
+typedef struct M3uLoad M3uLoad;
+static M3uLoad *m3u_load = NULL;
+static void m3u_load_free(M3uLoad *load);
+
+typedef struct RecursiveLoad {
+    TreeWalk *walk;
+    ScanNode *root;
+    pthread_mutex_t nodes_lock;
+    ScanNode **nodes;
+    int node_count;
+    int node_capacity;
+    pthread_mutex_t start_lock;
+    PlaylistInstall install;
+    atomic_int done;
+    int track_count;
+    double bytes_per_track;
+    pthread_t thread;
+    char root_path[PATH_MAX];
+} RecursiveLoad;
+
+enum { RESOLVE_PENDING, RESOLVE_EMPTY, RESOLVE_FOUND };
+
+static RecursiveLoad *recursive_load = NULL;
+
+static ScanNode *scan_node_new(RecursiveLoad *load, ScanNode *parent, char *name, int rank) {
+    ScanNode *node = calloc(1, sizeof(ScanNode));
+    if (!node) {
+        free(name);
+        return NULL;
+    }
+    node->parent = parent;
+    node->name = name;
+    node->rel = parent ? walk_join_path(parent->rel, name) : safe_strdup("");
+    node->depth = parent ? parent->depth + 1 : 0;
+    node->rank_path = parent ? malloc(node->depth * sizeof(int)) : NULL;
+    if (!node->rel || (parent && !node->rank_path)) {
+        free(node->rel);
+        free(name);
+        free(node);
+        return NULL;
+    }
+    if (parent) {
+        if (parent->depth) memcpy(node->rank_path, parent->rank_path, parent->depth * sizeof(int));
+        node->rank_path[parent->depth] = rank;
+    }
+    pthread_mutex_lock(&load->nodes_lock);
+    if (load->node_count >= load->node_capacity) {
+        int new_capacity = load->node_capacity ? load->node_capacity * 2 : 64;
+        ScanNode **grown = realloc(load->nodes, new_capacity * sizeof(ScanNode *));
+        if (!grown) {
+            pthread_mutex_unlock(&load->nodes_lock);
+            free(node->rank_path);
+            free(node->rel);
+            free(name);
+            free(node);
+            return NULL;
+        }
+        load->nodes = grown;
+        load->node_capacity = new_capacity;
     }
+    load->nodes[load->node_count++] = node;
+    pthread_mutex_unlock(&load->nodes_lock);
+    return node;
 }
-if (show_status && (time(NULL) - status_start_time >= STATUS_DURATION_SECONDS)) {
-    show_status = 0;
-    status_msg[0] = '\0';
-    draw_file_list(list_win);
+
+static int append_name(char ***names, int *count, int *capacity, const char *name) {
+    if (*count >= *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 16;
+        char **grown = realloc(*names, new_capacity * sizeof(char *));
+        if (!grown) return -1;
+        *names = grown;
+        *capacity = new_capacity;
+    }
+    char *dup = safe_strdup(name);
+    if (!dup) return -1;
+    (*names)[(*count)++] = dup;
+    return 0;
 }
-	    if (ch == ERR) {
-		        if (help_mode)
-		            draw_help(list_win, help_start_index);
-		        else
-		            draw_file_list(list_win);
-		        continue;
+
+static int scan_node_first(ScanNode *node, ScanNode **owner) {
+    if (!atomic_load_explicit(&node->scanned, memory_order_acquire)) return RESOLVE_PENDING;
+    if (atomic_load_explicit(&node->empty, memory_order_relaxed)) return RESOLVE_EMPTY;
+    const char *first_file = node->file_count > 0 ? node->files[0] : NULL;
+    for (int i = 0; i < node->subdir_count; i++) {
+        ScanNode *sub = node->subdirs[i];
+        if (first_file && sub->rank_path[node->depth] > node->file_ranks[0]) break;
+        int res = scan_node_first(sub, owner);
+        if (res != RESOLVE_EMPTY) return res;
     }
-	if (ch != 10) {
-	    show_error = 0;
-	    error_msg[0] = '\0';
-	    show_status = 0;
-	    status_msg[0] = '\0';
-	}
-    strcpy(status_msg, "");
-    if (ch == 'q' || ch == 'Q') break;
-    switch (ch) {
-case KEY_UP:
-case KEY_DOWN:
-    if (file_count > 0) {
-        if (ch == KEY_UP) {
-            if (selected_index > 0) {
-                selected_index--;
-            } else {
-                selected_index = file_count - 1;
-            }
+    if (first_file) {
+        *owner = node;
+        return RESOLVE_FOUND;
+    }
+    atomic_store_explicit(&node->empty, 1, memory_order_relaxed);
+    return RESOLVE_EMPTY;
+}
+
+static int scan_node_add_dir(RecursiveLoad *load, PlaylistBuilder *builder, ScanNode *node) {
+    if (node->rel[0] == '\0') return playlist_builder_add_dir(builder, load->root_path);
+    char dir[PATH_MAX];
+    if (snprintf(dir, sizeof(dir), "%s/%s", load->root_path, node->rel) >= (int)sizeof(dir)) return -1;
+    return playlist_builder_add_dir(builder, dir);
+}
+
+static void recursive_try_start(RecursiveLoad *load) {
+    if (atomic_load(&load->install.started)) return;
+    if (pthread_mutex_trylock(&load->start_lock) != 0) return;
+    ScanNode *owner = NULL;
+    if (!atomic_load(&load->install.started) && scan_node_first(load->root, &owner) == RESOLVE_FOUND) {
+        PlaylistBuilder builder = {0};
+        if (playlist_builder_add_track(&builder, scan_node_add_dir(load, &builder, owner), owner->files[0]) == 0) {
+            Playlist *playlist = playlist_builder_finish(&builder);
+            if (playlist) playlist_install(&load->install, playlist, 0);
         } else {
-            if (selected_index < file_count - 1) {
-                selected_index++;
-            } else {
-                selected_index = 0;
-            }
+            playlist_builder_free(&builder);
         }
     }
-    break;
-case KEY_LEFT:
-case KEY_RIGHT:
-    {
-        if (ch == KEY_LEFT) {
-            if (strcmp(current_dir, "/") == 0) {
-                display_message(STATUS, "Already at filesystem root");
-                break;
-            }
-
-            char temp_path[PATH_MAX];
-            strncpy(temp_path, current_dir, sizeof(temp_path)-1);
-            temp_path[sizeof(temp_path)-1] = '\0';
+    pthread_mutex_unlock(&load->start_lock);
+}
 
-            char *last_slash = strrchr(temp_path, '/');
-            if (last_slash == temp_path) {
-                strcpy(temp_path, "/");
-            } else if (last_slash) {
-                *last_slash = '\0';
-            }
-            if (add_to_forward(current_dir) == 0) {
-                if (navigate_dir(temp_path, status_msg) == 0) {
-                } else {
-                    if (forward_count > 0) {
-                        SAFE_FREE(forward_history[forward_count - 1]);
-                        forward_history[forward_count - 1] = NULL;
-                        forward_count--;
-                    }
-                }
-            } else {
-                display_message(STATUS, "Cannot save forward history");
+static void recursive_visit(TreeWalk *walk, int worker, WalkTask *task, DIR *dir) {
+    RecursiveLoad *load = (RecursiveLoad *)walk->user;
+    ScanNode *node = (ScanNode *)task->node;
+    char **files = NULL, **dirs = NULL;
+    int file_count = 0, file_capacity = 0, dir_count = 0, dir_capacity = 0;
+    if (dir) {
+        int dir_fd = dirfd(dir);
+        struct dirent *entry;
+        while (!atomic_load_explicit(&walk->cancel, memory_order_relaxed) && (entry = readdir(dir))) {
+            if (should_skip_entry(entry, 0)) continue;
+            atomic_fetch_add_explicit(&walk->workers[worker].entries, 1, memory_order_relaxed);
+            int type = walk_entry_type(dir_fd, entry);
+            if (type == DT_DIR) {
+                append_name(&dirs, &dir_count, &dir_capacity, entry->d_name);
+            } else if (type == DT_REG && is_raw_file(entry->d_name)) {
+                append_name(&files, &file_count, &file_capacity, entry->d_name);
             }
+        }
+    }
+    if (file_count > 1) qsort(files, file_count, sizeof(char *), order_names_cmp);
+    if (dir_count > 1) qsort(dirs, dir_count, sizeof(char *), order_names_cmp);
+    int *ranks = file_count + dir_count > 0 ? malloc((file_count + dir_count) * sizeof(int)) : NULL;
+    if (!ranks) {
+        free_names(files, file_count, 0);
+        files = NULL;
+        file_count = 0;
+    }
+    for (int i = 0, j = 0; ranks && (i < file_count || j < dir_count);) {
+        if (j >= dir_count || (i < file_count && order_names(files[i], dirs[j]) < 0)) {
+            ranks[i] = i + j;
+            i++;
         } else {
-            if (forward_count > 0) {
-                char *next_dir = forward_history[forward_count - 1];
-                if (navigate_dir(next_dir, status_msg) == 0) {
-                    free(forward_history[forward_count - 1]);
-                    forward_history[forward_count - 1] = NULL;
-                    forward_count--;
-                }
-            } else {
-                display_message(STATUS, "No forward history");
+            ranks[file_count + j] = i + j;
+            j++;
+        }
+    }
+    ScanNode **subdirs = dir_count > 0 && ranks ? calloc(dir_count, sizeof(ScanNode *)) : NULL;
+    int subdir_count = 0;
+    for (int i = 0; i < dir_count; i++) {
+        ScanNode *child = subdirs ? scan_node_new(load, node, dirs[i], ranks[file_count + i]) : NULL;
+        if (!child) {
+            if (!subdirs) free(dirs[i]);
+            continue;
+        }
+        subdirs[subdir_count++] = child;
+    }
+    free(dirs);
+    node->files = files;
+    node->file_ranks = ranks;
+    node->file_count = file_count;
+    node->subdirs = subdirs;
+    node->subdir_count = subdir_count;
+    atomic_store_explicit(&node->scanned, 1, memory_order_release);
+    for (int i = subdir_count - 1; i >= 0; i--) {
+        char *rel = safe_strdup(subdirs[i]->rel);
+        if (rel) walk_push(walk, worker, rel, subdirs[i]);
+    }
+    recursive_try_start(load);
+}
+
+typedef struct MergeRun {
+    ScanNode *node;
+    int pos;
+    int dir;
+} MergeRun;
+
+static int merge_run_less(const MergeRun *a, const MergeRun *b) {
+    const ScanNode *node_a = a->node, *node_b = b->node;
+    int depth = node_a->depth < node_b->depth ? node_a->depth : node_b->depth;
+    for (int i = 0; i < depth; i++) {
+        if (node_a->rank_path[i] != node_b->rank_path[i]) return node_a->rank_path[i] < node_b->rank_path[i];
+    }
+    int rank_a = node_a->depth > depth ? node_a->rank_path[depth] : node_a->file_ranks[a->pos];
+    int rank_b = node_b->depth > depth ? node_b->rank_path[depth] : node_b->file_ranks[b->pos];
+    return rank_a < rank_b;
+}
+
+static void merge_sift_down(MergeRun *heap, int size, int i) {
+    while (1) {
+        int smallest = i;
+        int left = 2 * i + 1, right = 2 * i + 2;
+        if (left < size && merge_run_less(&heap[left], &heap[smallest])) smallest = left;
+        if (right < size && merge_run_less(&heap[right], &heap[smallest])) smallest = right;
+        if (smallest == i) return;
+        MergeRun tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+static Playlist *recursive_merge(RecursiveLoad *load) {
+    int run_count = 0;
+    for (int i = 0; i < load->node_count; i++) {
+        if (load->nodes[i]->file_count > 0) run_count++;
+    }
+    if (run_count == 0) return NULL;
+    MergeRun *heap = malloc(run_count * sizeof(MergeRun));
+    if (!heap) {
+        memory_error();
+        return NULL;
+    }
+    PlaylistBuilder builder = {0};
+    int size = 0;
+    for (int i = 0; i < load->node_count; i++) {
+        if (load->nodes[i]->file_count > 0) {
+            heap[size].node = load->nodes[i];
+            heap[size].pos = 0;
+            heap[size].dir = scan_node_add_dir(load, &builder, load->nodes[i]);
+            size++;
+        }
+    }
+    for (int i = size / 2 - 1; i >= 0; i--) merge_sift_down(heap, size, i);
+    while (size > 0) {
+        if (playlist_builder_add_track(&builder, heap[0].dir, heap[0].node->files[heap[0].pos]) != 0) {
+            free(heap);
+            playlist_builder_free(&builder);
+            memory_error();
+            return NULL;
+        }
+        if (++heap[0].pos >= heap[0].node->file_count) heap[0] = heap[--size];
+        merge_sift_down(heap, size, 0);
+    }
+    free(heap);
+    return playlist_builder_finish(&builder);
+}
+
+static void *recursive_load_thread(void *arg) {
+    RecursiveLoad *load = (RecursiveLoad *)arg;
+    tree_walk_join(load->walk);
+    if (!atomic_load(&load->walk->cancel)) {
+        Playlist *playlist = recursive_merge(load);
+        if (playlist) {
+            int count = playlist->count;
+            double per_track = playlist_bytes_per_track(playlist);
+            if (playlist_install(&load->install, playlist, 1)) {
+                load->track_count = count;
+                load->bytes_per_track = per_track;
             }
         }
-        break;
     }
-        case 10:
-	            if (file_count > 0 && selected_index >= 0 && file_list && file_list[selected_index].name) {
-                if (!file_list[selected_index].is_dir) {
-                    if (is_raw_file(file_list[selected_index].name)) {
-                        char *full_path = xasprintf("%s/%s", current_dir, file_list[selected_index].name);
-                        if (!full_path) {
-                            display_message(STATUS, "Out of memory! Cannot play file.");
-                            break;
-                        }
-                        start_playback(full_path, file_list[selected_index].name, 0);
-                        free(full_path);
-                    } else {
-                        display_message(ERROR, "Not a .raw file");
-                    }
-	                } else {
-   int dir_fd = openat(AT_FDCWD, file_list[selected_index].name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
-    if (dir_fd == -1) {
-display_message(ERROR, ACCESS_DENIED_MSG, xasprintf("%s/%s", current_dir, file_list[selected_index].name));
-        break;
+    atomic_store(&load->done, 1);
+    return NULL;
+}
+
+static void recursive_load_free(RecursiveLoad *load) {
+    if (!load) return;
+    if (load->walk) {
+        atomic_store(&load->walk->cancel, 1);
+        pthread_join(load->thread, NULL);
+        tree_walk_destroy(load->walk);
+    }
+    for (int i = 0; i < load->node_count; i++) {
+        ScanNode *node = load->nodes[i];
+        free_names(node->files, node->file_count, 0);
+        free(node->file_ranks);
+        free(node->rank_path);
+        free(node->subdirs);
+        free(node->name);
+        free(node->rel);
+        free(node);
+    }
+    free(load->nodes);
+    pthread_mutex_destroy(&load->nodes_lock);
+    pthread_mutex_destroy(&load->start_lock);
+    free(load);
+}
+
+static void load_playlist_recursive(const char *dir_path) {
+    recursive_load_free(recursive_load);
+    recursive_load = NULL;
+    m3u_load_free(m3u_load);
+    m3u_load = NULL;
+    char resolved[PATH_MAX];
+    if (!realpath(dir_path, resolved)) {
+        display_message(ERROR, ACCESS_DENIED_MSG, dir_path);
+        return;
+    }
+    RecursiveLoad *load = calloc(1, sizeof(RecursiveLoad));
+    if (!load) {
+        memory_error();
+        return;
+    }
+    SAFE_STRNCPY(load->root_path, resolved, sizeof(load->root_path));
+    pthread_mutex_init(&load->nodes_lock, NULL);
+    pthread_mutex_init(&load->start_lock, NULL);
+    load->root = scan_node_new(load, NULL, safe_strdup(""), 0);
+    if (!load->root) {
+        recursive_load_free(load);
+        return;
+    }
+    setlocale(LC_COLLATE, "");
+    playlist_install_begin(&load->install, load->root_path);
+    load->walk = tree_walk_start(load->root_path, recursive_visit, load, load->root);
+    if (!load->walk) {
+        recursive_load_free(load);
+        return;
+    }
+    if (pthread_create(&load->thread, NULL, recursive_load_thread, load) != 0) {
+        display_message(ERROR, "pthread_create failed — recursive playlist disabled");
+        tree_walk_destroy(load->walk);
+        load->walk = NULL;
+        recursive_load_free(load);
+        return;
+    }
+    recursive_load = load;
+    display_message(STATUS, "Scanning folder tree for .raw files...");
+}
+
+static void recursive_load_poll(void) {
+    RecursiveLoad *load = recursive_load;
+    if (!load) return;
+    pthread_mutex_lock(&load->nodes_lock);
+    int folders = load->node_count;
+    pthread_mutex_unlock(&load->nodes_lock);
+    if (!atomic_load(&load->done)) {
+        display_message(STATUS, "Scanning tree: %d folders | %ld entries%s",
+                        folders, tree_walk_entries(load->walk),
+                        atomic_load(&load->install.started) ? " | playing first track" : "");
+        return;
+    }
+    if (load->track_count > 0) {
+        display_message(STATUS, "Recursive playlist: %d tracks from %d folders (%.0f B/track)",
+                        load->track_count, folders, load->bytes_per_track);
+    } else if (!atomic_load(&load->install.started)) {
+        display_message(ERROR, "Directory does not contain raw files.");
+    }
+    recursive_load_free(load);
+    recursive_load = NULL;
+}
+
+#define M3U_MAX_ENTRIES 65536
+
+static int is_m3u_file(const char *name) {
+    if (!name) return 0;
+    size_t len = strlen(name);
+    return (len > 4 && strcasecmp(name + len - 4, ".m3u") == 0) ||
+           (len > 5 && strcasecmp(name + len - 5, ".m3u8") == 0);
+}
+
+static int check_raw_header(const struct stat *st, const char *header, size_t header_len,
+                            const char *name, char *msg, size_t msg_size) {
+    if (!S_ISREG(st->st_mode)) {
+        snprintf(msg, msg_size, "Not a regular file: %s", name);
+        return -1;
+    }
+    if (st->st_size == 0) {
+        snprintf(msg, msg_size, "File '%s' is empty (0 bytes)", name);
+        return -1;
+    }
+    if (st->st_size < 4) {
+        snprintf(msg, msg_size, "File '%s' too small for a single frame (%ld bytes < 4)", name, (long)st->st_size);
+        return -1;
+    }
+    if (st->st_size % 4 != 0) {
+        snprintf(msg, msg_size,
+            "File '%s': size %ld bytes not multiple of 4. "
+            "Required: stereo 16-bit RAW (2ch × 2bytes = 4bytes/frame)",
+            name, (long)st->st_size);
+        return -1;
+    }
+    if (header_len >= 4) {
+        if (memcmp(header, "RIFF", 4) == 0 || memcmp(header, "OggS", 4) == 0 ||
+            memcmp(header, "fLaC", 4) == 0 || memcmp(header, "FORM", 4) == 0) {
+            snprintf(msg, msg_size, "File '%s' appears to be formatted audio (e.g., WAV/OGG/FLAC/AIFF), not raw PCM", name);
+            return -1;
+        }
     }
+    if (st->st_size < 1024) {
+        snprintf(msg, msg_size, "File '%s' is very small (%ld bytes). Playback may be short.", name, (long)st->st_size);
+        return 1;
+    }
+    msg[0] = '\0';
+    return 0;
+}
+
+static int check_raw_file(const char *path, const char *name, char *msg, size_t msg_size) {
     struct stat st;
-    if (fstat(dir_fd, &st) != 0 || !S_ISDIR(st.st_mode)) {
-        display_message(ERROR, "Not a directory or state changed: %s/%s", current_dir, file_list[selected_index].name);
-        close(dir_fd);
-        break;
+    if (stat(path, &st) != 0) {
+        snprintf(msg, msg_size, "Cannot access file: %s", name);
+        return -1;
     }
-    if (fchdir(dir_fd) != 0) {
-display_message(ERROR, ACCESS_DENIED_MSG, xasprintf("%s/%s", current_dir, file_list[selected_index].name));
-        close(dir_fd);
-        break;
+    char header[4] = {0};
+    size_t read = 0;
+    if (S_ISREG(st.st_mode) && st.st_size >= 4) {
+        FILE *temp_file = fopen(path, "rb");
+        if (!temp_file) {
+            snprintf(msg, msg_size, "Failed to open for validation: %s", name);
+            return -1;
+        }
+        read = fread(header, 1, 4, temp_file);
+        fclose(temp_file);
     }
-                    close(dir_fd);
-	                    char old_dir[PATH_MAX];
-                    SAFE_STRNCPY(old_dir, current_dir, sizeof(old_dir));
-                    old_dir[sizeof(old_dir)-1] = '\0';
-	                    if (getcwd(current_dir, PATH_MAX) == NULL) {
-	                        display_message(STATUS, "getcwd failed after fchdir");
+    return check_raw_header(&st, header, read, name, msg, msg_size);
+}
+
+struct M3uLoad {
+    PlaylistInstall install;
+    char **paths;
+    atomic_schar *status;
+    int count;
+    atomic_int next;
+    atomic_int checked;
+    atomic_int cancel;
+    atomic_int done;
+    int valid;
+    int rejected;
+    int worker_count;
+    pthread_t workers[WALK_MAX_THREADS];
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    char first_error[256];
+    char list_path[PATH_MAX];
+};
+
+static void *m3u_validate_worker(void *arg) {
+    M3uLoad *load = (M3uLoad *)arg;
+    char msg[256];
+    int index;
+    while (!atomic_load(&load->cancel) && (index = atomic_fetch_add(&load->next, 1)) < load->count) {
+        const char *path = load->paths[index];
+        const char *slash = strrchr(path, '/');
+        int result = check_raw_file(path, slash ? slash + 1 : path, msg, sizeof(msg));
+        pthread_mutex_lock(&load->lock);
+        atomic_store(&load->status[index], result < 0 ? -1 : 1);
+        if (result < 0 && !load->first_error[0]) SAFE_STRNCPY(load->first_error, msg, sizeof(load->first_error));
+        atomic_fetch_add(&load->checked, 1);
+        pthread_cond_broadcast(&load->cond);
+        pthread_mutex_unlock(&load->lock);
+    }
+    return NULL;
+}
+
+static void *m3u_load_thread(void *arg) {
+    M3uLoad *load = (M3uLoad *)arg;
+    int front = 0;
+    pthread_mutex_lock(&load->lock);
+    while (!atomic_load(&load->cancel) && front < load->count) {
+        signed char status = atomic_load(&load->status[front]);
+        if (status == 0) {
+            pthread_cond_wait(&load->cond, &load->lock);
+        } else if (status < 0) {
+            front++;
+        } else {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&load->lock);
+    if (!atomic_load(&load->cancel) && front < load->count) {
+        PlaylistBuilder builder = {0};
+        if (playlist_builder_add_path(&builder, load->paths[front]) == 0) {
+            Playlist *playlist = playlist_builder_finish(&builder);
+            if (playlist) playlist_install(&load->install, playlist, 0);
+        } else {
+            playlist_builder_free(&builder);
+        }
+    }
+    for (int i = 0; i < load->worker_count; i++) pthread_join(load->workers[i], NULL);
+    load->worker_count = 0;
+    if (!atomic_load(&load->cancel)) {
+        PlaylistBuilder builder = {0};
+        int failed = 0;
+        for (int i = 0; i < load->count && !failed; i++) {
+            if (atomic_load(&load->status[i]) > 0)
+                failed = playlist_builder_add_path(&builder, load->paths[i]) != 0;
+        }
+        load->valid = failed ? 0 : builder.count;
+        Playlist *playlist = failed ? NULL : playlist_builder_finish(&builder);
+        if (failed) playlist_builder_free(&builder);
+        if (playlist) playlist_install(&load->install, playlist, 1);
+        else if (atomic_load(&load->install.started)) {
+            SAFE_MUTEX_LOCK(&player_control.mutex);
+            if (player_control.playlist_generation == load->install.generation)
+                player_control.playlist_loading = 0;
+            pthread_mutex_unlock(&player_control.mutex);
+        }
+    }
+    atomic_store(&load->done, 1);
+    return NULL;
+}
+
+static void m3u_load_free(M3uLoad *load) {
+    if (!load) return;
+    atomic_store(&load->cancel, 1);
+    pthread_mutex_lock(&load->lock);
+    pthread_cond_broadcast(&load->cond);
+    pthread_mutex_unlock(&load->lock);
+    if (load->thread) pthread_join(load->thread, NULL);
+    for (int i = 0; i < load->worker_count; i++) pthread_join(load->workers[i], NULL);
+    free_names(load->paths, load->count, 0);
+    free(load->status);
+    pthread_mutex_destroy(&load->lock);
+    pthread_cond_destroy(&load->cond);
+    free(load);
+}
+
+static char *m3u_file_uri_path(const char *uri) {
+    const char *path = uri + 5;
+    if (strncmp(path, "//", 2) == 0) {
+        path += 2;
+        const char *host_end = strchr(path, '/');
+        if (!host_end) return NULL;
+        size_t host_len = (size_t)(host_end - path);
+        if (host_len != 0 && !(host_len == 9 && strncasecmp(path, "localhost", 9) == 0)) return NULL;
+        path = host_end;
+    }
+    if (path[0] != '/') return NULL;
+    char *decoded = malloc(strlen(path) + 1);
+    if (!decoded) return NULL;
+    size_t n = 0;
+    for (const char *p = path; *p; p++) {
+        if (*p != '%') {
+            decoded[n++] = *p;
+            continue;
+        }
+        char hex[3] = {p[1], p[1] ? p[2] : '\0', '\0'};
+        long value = (isxdigit((unsigned char)hex[0]) && isxdigit((unsigned char)hex[1])) ? strtol(hex, NULL, 16) : 0;
+        if (value == 0) {
+            free(decoded);
+            return NULL;
+        }
+        decoded[n++] = (char)value;
+        p += 2;
+    }
+    decoded[n] = '\0';
+    return decoded;
+}
+
+static int m3u_read_entries(M3uLoad *load, const char *list_path) {
+    FILE *file = fopen(list_path, "r");
+    if (!file) return -1;
+    char base[PATH_MAX];
+    SAFE_STRNCPY(base, list_path, sizeof(base));
+    char *slash = strrchr(base, '/');
+    if (slash) *slash = '\0';
+    int capacity = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &line_size, file)) != -1 && load->count < M3U_MAX_ENTRIES) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '\t'))
+            line[--len] = '\0';
+        char *entry = line;
+        if (load->count == 0 && (unsigned char)entry[0] == 0xEF && (unsigned char)entry[1] == 0xBB && (unsigned char)entry[2] == 0xBF)
+            entry += 3;
+        while (*entry == ' ' || *entry == '\t') entry++;
+        if (*entry == '\0' || *entry == '#') continue;
+        char *path;
+        if (strncasecmp(entry, "file:", 5) == 0) {
+            path = m3u_file_uri_path(entry);
+            if (!path) {
+                if (!load->rejected++)
+                    snprintf(load->first_error, sizeof(load->first_error), "not a local file: URI: %.200s", entry);
+                continue;
+            }
+        } else {
+            path = (entry[0] == '/') ? safe_strdup(entry) : xasprintf("%s/%s", base, entry);
+            if (!path) break;
+        }
+        if (load->count == capacity) {
+            int new_capacity = capacity ? capacity * 2 : 64;
+            char **grown = realloc(load->paths, new_capacity * sizeof(char *));
+            if (!grown) {
+                free(path);
+                break;
+            }
+            load->paths = grown;
+            capacity = new_capacity;
+        }
+        load->paths[load->count++] = path;
+    }
+    free(line);
+    fclose(file);
+    return 0;
+}
+
+static void load_playlist_m3u(const char *list_path) {
+    recursive_load_free(recursive_load);
+    recursive_load = NULL;
+    m3u_load_free(m3u_load);
+    m3u_load = NULL;
+    char resolved[PATH_MAX];
+    if (!realpath(list_path, resolved)) {
+        display_message(ERROR, ACCESS_DENIED_MSG, list_path);
+        return;
+    }
+    M3uLoad *load = calloc(1, sizeof(M3uLoad));
+    if (!load) {
+        memory_error();
+        return;
+    }
+    pthread_mutex_init(&load->lock, NULL);
+    pthread_cond_init(&load->cond, NULL);
+    SAFE_STRNCPY(load->list_path, resolved, sizeof(load->list_path));
+    if (m3u_read_entries(load, resolved) != 0) {
+        display_message(ERROR, "Cannot read playlist: %s", resolved);
+        m3u_load_free(load);
+        return;
+    }
+    if (load->count == 0) {
+        if (load->rejected > 0) display_message(ERROR, "No playable entries in %s: %s", basename(resolved), load->first_error);
+        else display_message(ERROR, "Playlist contains no entries: %s", basename(resolved));
+        m3u_load_free(load);
+        return;
+    }
+    load->status = calloc(load->count, sizeof(atomic_schar));
+    if (!load->status) {
+        memory_error();
+        m3u_load_free(load);
+        return;
+    }
+    char dir[PATH_MAX];
+    SAFE_STRNCPY(dir, resolved, sizeof(dir));
+    playlist_install_begin(&load->install, dirname(dir));
+    int count = io_worker_count();
+    if (count > load->count) count = load->count;
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&load->workers[i], NULL, m3u_validate_worker, load) != 0) break;
+        load->worker_count++;
+    }
+    if (load->worker_count == 0 || pthread_create(&load->thread, NULL, m3u_load_thread, load) != 0) {
+        display_message(ERROR, "pthread_create failed — M3U playlist disabled");
+        m3u_load_free(load);
+        return;
+    }
+    m3u_load = load;
+    display_message(STATUS, "Validating %d playlist entries...", load->count);
+}
+
+static void m3u_load_poll(void) {
+    M3uLoad *load = m3u_load;
+    if (!load) return;
+    if (!atomic_load(&load->done)) {
+        display_message(STATUS, "Validating playlist: %d/%d entries%s",
+                        atomic_load(&load->checked), load->count,
+                        atomic_load(&load->install.started) ? " | playing first track" : "");
+        return;
+    }
+    int skipped = load->count - load->valid + load->rejected;
+    if (load->valid > 0 && skipped > 0) {
+        display_message(STATUS, "M3U playlist: %d tracks from %s | skipped %d invalid (%s)",
+                        load->valid, basename(load->list_path), skipped, load->first_error);
+    } else if (load->valid > 0) {
+        display_message(STATUS, "M3U playlist: %d tracks from %s", load->valid, basename(load->list_path));
+    } else {
+        display_message(ERROR, "No playable entries in %s%s%s", basename(load->list_path),
+                        load->first_error[0] ? ": " : "", load->first_error);
+    }
+    m3u_load_free(load);
+    m3u_load = NULL;
+}
+
+static int save_playlist_m3u(const char *list_path) {
+    char *text = NULL;
+    size_t text_size = 0;
+    FILE *mem = open_memstream(&text, &text_size);
+    if (!mem) return -1;
+    int count = 0;
+    char path[PATH_MAX];
+    fputs("#EXTM3U\n", mem);
+    pthread_mutex_lock(&player_control.mutex);
+    Playlist *playlist = player_control.playlist;
+    for (int i = 0; playlist && i < playlist->count; i++) {
+        if (playlist_track_path(playlist, i, path, sizeof(path)) != 0) continue;
+        fprintf(mem, "%s\n", path);
+        count++;
+    }
+    pthread_mutex_unlock(&player_control.mutex);
+    if (fclose(mem) != 0 || count == 0) {
+        free(text);
+        return count == 0 ? 0 : -1;
+    }
+    char *temp_path = xasprintf("%s.tmp", list_path);
+    int fd = temp_path ? open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+    int ok = fd != -1;
+    for (size_t off = 0; ok && off < text_size;) {
+        ssize_t n = write(fd, text + off, text_size - off);
+        if (n < 0 && errno == EINTR) continue;
+        ok = n > 0;
+        if (ok) off += (size_t)n;
+    }
+    if (fd != -1 && close(fd) != 0) ok = 0;
+    if (ok && rename(temp_path, list_path) != 0) ok = 0;
+    if (!ok && temp_path) unlink(temp_path);
+    free(temp_path);
+    free(text);
+    return ok ? count : -1;
+}
+
+static void save_playlist_prompt(void) {
+    pthread_mutex_lock(&player_control.mutex);
+    int size = player_control.playlist_size;
+    pthread_mutex_unlock(&player_control.mutex);
+    if (size == 0) {
+        display_message(ERROR, "No playlist to save");
+        return;
+    }
+    char name[PATH_MAX] = "playlist.m3u";
+    if (prompt_input(list_win, "SAVE PLAYLIST AS", name, sizeof(name)) != 0 || !name[0]) return;
+    char *full_path = (name[0] == '/') ? safe_strdup(name) : xasprintf("%s/%s", current_dir, name);
+    if (!full_path) {
+        memory_error();
+        return;
+    }
+    int saved = save_playlist_m3u(full_path);
+    if (saved > 0) {
+        display_message(STATUS, "Saved %d tracks to %s", saved, name);
+        update_file_list();
+    } else {
+        display_message(ERROR, "Failed to save playlist: %s", name);
+    }
+    free(full_path);
+}
+
+static int collect_entry_paths(const FileEntry *entry, char ***paths, int *count, int *capacity) {
+    char *full_path = xasprintf("%s/%s", current_dir, entry->name);
+    if (!full_path) return -1;
+    int added = 0;
+    if (entry->is_dir) {
+        Playlist *playlist = NULL;
+        if (load_raw_files(full_path, &playlist) == 0 && playlist) {
+            char path[PATH_MAX];
+            for (int i = 0; i < playlist->count; i++) {
+                if (playlist_track_path(playlist, i, path, sizeof(path)) == 0 &&
+                    append_name(paths, count, capacity, path) == 0)
+                    added++;
+            }
+            free(playlist);
+        }
+    } else if (is_raw_file(entry->name)) {
+        char msg[256];
+        char resolved[PATH_MAX];
+        if (check_raw_file(full_path, entry->name, msg, sizeof(msg)) < 0) {
+            display_message(ERROR, "%s", msg);
+        } else if (realpath(full_path, resolved) && append_name(paths, count, capacity, resolved) == 0) {
+            added++;
+        }
+    }
+    free(full_path);
+    return added;
+}
+
+static void enqueue_paths(char **paths, int count) {
+    PlayerControl *control = &player_control;
+    if (count == 0) {
+        free(paths);
+        display_message(ERROR, "Nothing to enqueue");
+        return;
+    }
+    pthread_mutex_lock(&control->mutex);
+    if (queue_append(control, paths, count) != 0) {
+        pthread_mutex_unlock(&control->mutex);
+        free_names(paths, count, 0);
+        memory_error();
+        return;
+    }
+    free(paths);
+    int started = 0;
+    if (!control->filename && !control->current_file && !control->stop) {
+        control->filename = queue_pop(control);
+        control->loop_mode = 0;
+        control->paused = 0;
+        control->is_silent = 0;
+        control->fading_in = 0;
+        control->fading_out = 0;
+        control->current_fade = FADE_FRAMES;
+        control->bytes_read = 0LL;
+        control->duration = 0.0;
+        control->seek_delta = 0;
+        control->seek_target = -1;
+        started = 1;
+    }
+    int waiting = control->queue_count;
+    pthread_cond_broadcast(&control->cond);
+    pthread_mutex_unlock(&control->mutex);
+    if (started) {
+        display_message(STATUS, "Queued %d tracks, playing the first | %d waiting", count, waiting);
+    } else {
+        display_message(STATUS, "Queued %d tracks | %d waiting", count, waiting);
+    }
+}
+
+static void enqueue_selected(void) {
+    if (file_count <= 0 || selected_index < 0 || !file_list || !file_list[selected_index].name) return;
+    char **paths = NULL;
+    int count = 0, capacity = 0;
+    if (collect_entry_paths(&file_list[selected_index], &paths, &count, &capacity) < 0) memory_error();
+    enqueue_paths(paths, count);
+}
+
+static void enqueue_marked(void) {
+    char **paths = NULL;
+    int count = 0, capacity = 0, marked = 0;
+    for (int i = 0; i < file_count && file_list; i++) {
+        if (!file_list[i].marked || !file_list[i].name) continue;
+        marked++;
+        if (collect_entry_paths(&file_list[i], &paths, &count, &capacity) < 0) memory_error();
+        file_list[i].marked = 0;
+    }
+    if (marked == 0) {
+        display_message(ERROR, "No marked entries (mark with 'm')");
+        return;
+    }
+    enqueue_paths(paths, count);
+}
+
+static void toggle_mark_selected(void) {
+    if (file_count <= 0 || selected_index < 0 || !file_list || !file_list[selected_index].name) return;
+    FileEntry *entry = &file_list[selected_index];
+    if (!entry->is_dir && !is_raw_file(entry->name)) {
+        display_message(ERROR, "Only .raw files and folders can be marked");
+        return;
+    }
+    entry->marked = !entry->marked;
+    if (selected_index < file_count - 1) selected_index++;
+}
+
+void action_clear_queue(PlayerControl *control) {
+    int removed = control->queue_count;
+    queue_clear(control);
+    display_message(STATUS, "Queue cleared (%d removed)", removed);
+}
+
+typedef struct HoverCache {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int running;
+    int quit;
+    char *wanted;
+    char *path;
+    FILE *file;
+    int status;
+    char msg[256];
+    char *scratch;
+    unsigned long hits;
+    unsigned long misses;
+} HoverCache;
+
+static HoverCache hover_cache = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static int hover_prepare(HoverCache *cache, const char *path, FILE **file_out, char *msg, size_t msg_size) {
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+    *file_out = NULL;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        snprintf(msg, msg_size, "Cannot access file: %s", name);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        snprintf(msg, msg_size, "Cannot access file: %s", name);
+        return -1;
+    }
+    char header[4] = {0};
+    ssize_t got = S_ISREG(st.st_mode) ? pread(fd, header, sizeof(header), 0) : 0;
+    int status = check_raw_header(&st, header, got > 0 ? (size_t)got : 0, name, msg, msg_size);
+    if (status < 0) {
+        close(fd);
+        return status;
+    }
+    posix_fadvise(fd, 0, HOVER_READAHEAD_BYTES, POSIX_FADV_WILLNEED);
+    if (cache->scratch) {
+        ssize_t n;
+        do {
+            n = pread(fd, cache->scratch, HOVER_READAHEAD_BYTES, 0);
+        } while (n < 0 && errno == EINTR);
+    }
+    *file_out = fdopen(fd, "rb");
+    if (!*file_out) {
+        close(fd);
+        snprintf(msg, msg_size, "Failed to open for validation: %s", name);
+        return -1;
+    }
+    return status;
+}
+
+static void hover_drop(HoverCache *cache) {
+    if (cache->file) {
+        fclose(cache->file);
+        cache->file = NULL;
+    }
+    SAFE_FREE(cache->path);
+}
+
+static void *hover_thread(void *arg) {
+    HoverCache *cache = (HoverCache *)arg;
+    pthread_mutex_lock(&cache->lock);
+    while (!cache->quit) {
+        if (!cache->wanted || (cache->path && strcmp(cache->path, cache->wanted) == 0)) {
+            pthread_cond_wait(&cache->cond, &cache->lock);
+            continue;
+        }
+        char *target = safe_strdup(cache->wanted);
+        pthread_mutex_unlock(&cache->lock);
+        FILE *file = NULL;
+        char msg[256] = "";
+        int status = target ? hover_prepare(cache, target, &file, msg, sizeof(msg)) : -1;
+        pthread_mutex_lock(&cache->lock);
+        hover_drop(cache);
+        if (target && cache->wanted && strcmp(cache->wanted, target) == 0) {
+            cache->path = target;
+            cache->file = file;
+            cache->status = status;
+            SAFE_STRNCPY(cache->msg, msg, sizeof(cache->msg));
+        } else {
+            if (file) fclose(file);
+            free(target);
+            if (!target) break;
+        }
+    }
+    hover_drop(cache);
+    pthread_mutex_unlock(&cache->lock);
+    return NULL;
+}
+
+static void hover_start(void) {
+    hover_cache.scratch = malloc(HOVER_READAHEAD_BYTES);
+    if (pthread_create(&hover_cache.thread, NULL, hover_thread, &hover_cache) == 0) {
+        hover_cache.running = 1;
+    }
+}
+
+static void hover_stop(void) {
+    if (!hover_cache.running) return;
+    pthread_mutex_lock(&hover_cache.lock);
+    hover_cache.quit = 1;
+    pthread_cond_signal(&hover_cache.cond);
+    pthread_mutex_unlock(&hover_cache.lock);
+    pthread_join(hover_cache.thread, NULL);
+    hover_cache.running = 0;
+    SAFE_FREE(hover_cache.wanted);
+    SAFE_FREE(hover_cache.scratch);
+}
+
+static void hover_request(const char *path) {
+    if (!hover_cache.running) return;
+    pthread_mutex_lock(&hover_cache.lock);
+    if (!path) {
+        SAFE_FREE(hover_cache.wanted);
+    } else if (!hover_cache.wanted || strcmp(hover_cache.wanted, path) != 0) {
+        assign_safe_strdup(&hover_cache.wanted, path);
+        pthread_cond_signal(&hover_cache.cond);
+    }
+    pthread_mutex_unlock(&hover_cache.lock);
+}
+
+static void hover_update(void) {
+    char path[PATH_MAX];
+    if (search_mode || file_count <= 0 || selected_index < 0 || selected_index >= file_count || !file_list ||
+        !file_list[selected_index].name || file_list[selected_index].is_dir ||
+        !is_raw_file(file_list[selected_index].name) ||
+        snprintf(path, sizeof(path), "%s/%s", current_dir, file_list[selected_index].name) >= (int)sizeof(path)) {
+        hover_request(NULL);
+        return;
+    }
+    hover_request(path);
+}
+
+static int hover_take(const char *path, FILE **file_out, char *msg, size_t msg_size) {
+    int status = HOVER_MISS;
+    *file_out = NULL;
+    pthread_mutex_lock(&hover_cache.lock);
+    if (hover_cache.path && strcmp(hover_cache.path, path) == 0) {
+        status = hover_cache.status;
+        SAFE_STRNCPY(msg, hover_cache.msg, msg_size);
+        *file_out = hover_cache.file;
+        hover_cache.file = NULL;
+        SAFE_FREE(hover_cache.path);
+        hover_cache.hits++;
+    } else {
+        hover_cache.misses++;
+    }
+    pthread_mutex_unlock(&hover_cache.lock);
+    return status;
+}
+
+typedef struct ListingEntry {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    FileEntry *entries;
+    int count;
+    unsigned long stamp;
+} ListingEntry;
+
+typedef struct ListingCache {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t workers[LISTING_WORKERS];
+    int worker_count;
+    int quit;
+    char *pending;
+    atomic_uint generation;
+    ListingEntry slots[LISTING_CACHE_SLOTS];
+    unsigned long stamp;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long stale;
+    unsigned long scans;
+    unsigned long cancelled;
+    char *hovered;
+    struct timespec hovered_since;
+    int requested;
+} ListingCache;
+
+static ListingCache listing_cache = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static int same_dir_state(const ListingEntry *slot, const struct stat *st) {
+    return slot->dev == st->st_dev && slot->ino == st->st_ino &&
+           slot->mtime.tv_sec == st->st_mtim.tv_sec && slot->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void listing_slot_free(ListingEntry *slot) {
+    free_names(slot->entries, slot->count, 1);
+    SAFE_FREE(slot->path);
+    slot->entries = NULL;
+    slot->count = 0;
+}
+
+static ListingEntry *listing_find(const char *path) {
+    for (int i = 0; i < LISTING_CACHE_SLOTS; i++) {
+        if (listing_cache.slots[i].path && strcmp(listing_cache.slots[i].path, path) == 0)
+            return &listing_cache.slots[i];
+    }
+    return NULL;
+}
+
+static int listing_scan(const char *dir_path, unsigned generation, struct stat *dir_st,
+                        FileEntry **entries_out, int *count_out) {
+    int dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1) return -1;
+    if (fstat(dir_fd, dir_st) != 0) {
+        close(dir_fd);
+        return -1;
+    }
+    DIR *dir = fdopendir(dir_fd);
+    if (!dir) {
+        close(dir_fd);
+        return -1;
+    }
+    FileEntry *entries = NULL;
+    int count = 0, capacity = 0, cancelled = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (atomic_load_explicit(&listing_cache.generation, memory_order_relaxed) != generation) {
+            cancelled = 1;
+            break;
+        }
+        if (should_skip_entry(entry, 0)) continue;
+        int is_dir;
+        if (entry->d_type == DT_DIR || entry->d_type == DT_REG) {
+            is_dir = entry->d_type == DT_DIR;
+        } else {
+            struct stat st;
+            if (fstatat(dir_fd, entry->d_name, &st, 0) != 0) continue;
+            is_dir = S_ISDIR(st.st_mode);
+        }
+        if (count == capacity) {
+            int new_capacity = capacity ? capacity * 2 : 64;
+            FileEntry *grown = realloc(entries, new_capacity * sizeof(FileEntry));
+            if (!grown) {
+                cancelled = 1;
+                break;
+            }
+            entries = grown;
+            capacity = new_capacity;
+        }
+        entries[count].name = strdup(entry->d_name);
+        if (!entries[count].name) continue;
+        entries[count].is_dir = is_dir;
+        entries[count].marked = 0;
+        count++;
+    }
+    closedir(dir);
+    if (cancelled) {
+        free_names(entries, count, 1);
+        return 1;
+    }
+    qsort(entries, count, sizeof(FileEntry), file_entry_cmp);
+    *entries_out = entries;
+    *count_out = count;
+    return 0;
+}
+
+static void listing_install(const char *path, const struct stat *st, FileEntry *entries, int count) {
+    ListingEntry *slot = listing_find(path);
+    if (!slot) {
+        slot = &listing_cache.slots[0];
+        for (int i = 0; i < LISTING_CACHE_SLOTS; i++) {
+            ListingEntry *candidate = &listing_cache.slots[i];
+            if (!candidate->path) {
+                slot = candidate;
+                break;
+            }
+            if (candidate->stamp < slot->stamp) slot = candidate;
+        }
+    }
+    listing_slot_free(slot);
+    slot->path = safe_strdup(path);
+    if (!slot->path) {
+        free_names(entries, count, 1);
+        return;
+    }
+    slot->dev = st->st_dev;
+    slot->ino = st->st_ino;
+    slot->mtime = st->st_mtim;
+    slot->entries = entries;
+    slot->count = count;
+    slot->stamp = ++listing_cache.stamp;
+}
+
+static void *listing_worker(void *arg) {
+    (void)arg;
+    pthread_setname_np(pthread_self(), "tapraw-listing");
+    pthread_mutex_lock(&listing_cache.lock);
+    while (!listing_cache.quit) {
+        if (!listing_cache.pending) {
+            pthread_cond_wait(&listing_cache.cond, &listing_cache.lock);
+            continue;
+        }
+        char *target = listing_cache.pending;
+        listing_cache.pending = NULL;
+        unsigned generation = atomic_load(&listing_cache.generation);
+        pthread_mutex_unlock(&listing_cache.lock);
+        char resolved[PATH_MAX];
+        struct stat st;
+        int fresh = 0;
+        if (realpath(target, resolved) && stat(resolved, &st) == 0) {
+            pthread_mutex_lock(&listing_cache.lock);
+            ListingEntry *slot = listing_find(resolved);
+            fresh = slot && same_dir_state(slot, &st);
+            pthread_mutex_unlock(&listing_cache.lock);
+        } else {
+            fresh = -1;
+        }
+        FileEntry *entries = NULL;
+        int count = 0;
+        int result = -1;
+        if (!fresh) {
+            trace_event("scan", 'B', 0);
+            result = listing_scan(resolved, generation, &st, &entries, &count);
+            trace_event("scan", 'E', count);
+        }
+        pthread_mutex_lock(&listing_cache.lock);
+        if (result == 0) {
+            listing_install(resolved, &st, entries, count);
+            listing_cache.scans++;
+        } else if (result == 1) {
+            listing_cache.cancelled++;
+        }
+        free(target);
+    }
+    pthread_mutex_unlock(&listing_cache.lock);
+    return NULL;
+}
+
+static void listing_start(void) {
+    for (int i = 0; i < LISTING_WORKERS; i++) {
+        if (pthread_create(&listing_cache.workers[i], NULL, listing_worker, NULL) != 0) break;
+        listing_cache.worker_count++;
+    }
+}
+
+static void listing_stop(void) {
+    pthread_mutex_lock(&listing_cache.lock);
+    listing_cache.quit = 1;
+    atomic_fetch_add(&listing_cache.generation, 1);
+    pthread_cond_broadcast(&listing_cache.cond);
+    pthread_mutex_unlock(&listing_cache.lock);
+    for (int i = 0; i < listing_cache.worker_count; i++) pthread_join(listing_cache.workers[i], NULL);
+    listing_cache.worker_count = 0;
+    for (int i = 0; i < LISTING_CACHE_SLOTS; i++) listing_slot_free(&listing_cache.slots[i]);
+    SAFE_FREE(listing_cache.pending);
+    SAFE_FREE(listing_cache.hovered);
+}
+
+static int listing_take(const char *dir_path, FileEntry **entries_out, int *count_out) {
+    struct stat st;
+    int hit = 0;
+    if (stat(dir_path, &st) != 0) return -1;
+    pthread_mutex_lock(&listing_cache.lock);
+    ListingEntry *slot = listing_find(dir_path);
+    if (slot && same_dir_state(slot, &st)) {
+        *entries_out = slot->entries;
+        *count_out = slot->count;
+        slot->entries = NULL;
+        slot->count = 0;
+        listing_slot_free(slot);
+        listing_cache.hits++;
+        hit = 1;
+    } else if (slot) {
+        listing_slot_free(slot);
+        listing_cache.stale++;
+    } else {
+        listing_cache.misses++;
+    }
+    pthread_mutex_unlock(&listing_cache.lock);
+    return hit ? 0 : -1;
+}
+
+static void listing_update(void) {
+    char path[PATH_MAX];
+    int on_dir = !search_mode && file_count > 0 && selected_index >= 0 && selected_index < file_count &&
+                 file_list && file_list[selected_index].name && file_list[selected_index].is_dir &&
+                 snprintf(path, sizeof(path), "%s/%s", current_dir, file_list[selected_index].name) < (int)sizeof(path);
+    if (!on_dir || !listing_cache.hovered || strcmp(listing_cache.hovered, path) != 0) {
+        if (listing_cache.hovered) {
+            pthread_mutex_lock(&listing_cache.lock);
+            atomic_fetch_add(&listing_cache.generation, 1);
+            SAFE_FREE(listing_cache.pending);
+            pthread_mutex_unlock(&listing_cache.lock);
+            SAFE_FREE(listing_cache.hovered);
+        }
+        if (on_dir) {
+            listing_cache.hovered = safe_strdup(path);
+            clock_gettime(CLOCK_MONOTONIC, &listing_cache.hovered_since);
+            listing_cache.requested = 0;
+        }
+        return;
+    }
+    if (listing_cache.requested || listing_cache.worker_count == 0) return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long waited_ms = (now.tv_sec - listing_cache.hovered_since.tv_sec) * 1000 +
+                     (now.tv_nsec - listing_cache.hovered_since.tv_nsec) / 1000000;
+    if (waited_ms < LISTING_HOVER_DELAY_MS) return;
+    pthread_mutex_lock(&listing_cache.lock);
+    assign_safe_strdup(&listing_cache.pending, path);
+    pthread_cond_signal(&listing_cache.cond);
+    pthread_mutex_unlock(&listing_cache.lock);
+    listing_cache.requested = 1;
+}
+
+static void draw_debug_overlay(WINDOW *win) {
+    char lines[DEBUG_OVERLAY_LINES][96];
+    int n = 0;
+    pthread_mutex_lock(&hover_cache.lock);
+    snprintf(lines[n++], sizeof(lines[0]), "hover prefetch  hits %lu  misses %lu",
+             hover_cache.hits, hover_cache.misses);
+    pthread_mutex_unlock(&hover_cache.lock);
+    pthread_mutex_lock(&listing_cache.lock);
+    int cached = 0;
+    for (int i = 0; i < LISTING_CACHE_SLOTS; i++) cached += listing_cache.slots[i].path != NULL;
+    snprintf(lines[n++], sizeof(lines[0]), "listing cache   hits %lu  misses %lu  stale %lu  cached %d/%d",
+             listing_cache.hits, listing_cache.misses, listing_cache.stale, cached, LISTING_CACHE_SLOTS);
+    snprintf(lines[n++], sizeof(lines[0]), "listing scans   done %lu  cancelled %lu  workers %d",
+             listing_cache.scans, listing_cache.cancelled, listing_cache.worker_count);
+    pthread_mutex_unlock(&listing_cache.lock);
+    pthread_mutex_lock(&audio_warmup.lock);
+    if (!audio_warmup.done) {
+        snprintf(lines[n++], sizeof(lines[0]), "audio device    opening in background");
+    } else {
+        snprintf(lines[n++], sizeof(lines[0]), "output sink     %s  %s  open %.1f ms", sink_spec ? sink_spec : "alsa",
+                 audio_warmup.taken ? "in use" : (audio_warmup.sink ? "warm, idle" : "open failed"),
+                 audio_warmup.open_ms);
+    }
+    pthread_mutex_unlock(&audio_warmup.lock);
+    pthread_mutex_lock(&player_control.mutex);
+    if (player_control.ttfs_count > 0) {
+        snprintf(lines[n++], sizeof(lines[0]), "first sample    last %.1f ms  avg %.1f ms  (%lu starts)",
+                 player_control.ttfs_last_ms, player_control.ttfs_total_ms / player_control.ttfs_count,
+                 player_control.ttfs_count);
+    } else {
+        snprintf(lines[n++], sizeof(lines[0]), "first sample    no Enter starts yet");
+    }
+    if (player_control.loop_a >= 0) {
+        char a[32], b[32] = "-";
+        format_frame_time(a, sizeof(a), player_control.loop_a);
+        if (player_control.loop_b >= 0) format_frame_time(b, sizeof(b), player_control.loop_b);
+        snprintf(lines[n++], sizeof(lines[0]), "A-B loop        A %s  B %s  (%lld frames)", a, b,
+                 player_control.loop_b >= 0 ? player_control.loop_b - player_control.loop_a : 0LL);
+    }
+    snprintf(lines[n++], sizeof(lines[0]), "kernels %-7s peak %6.1f dBFS  rms %6.1f dBFS", kernels.name,
+             20.0 * log10((player_control.level_peak + 1) / 32768.0),
+             20.0 * log10((player_control.level_rms + 1.0) / 32768.0));
+    pthread_mutex_unlock(&player_control.mutex);
+    snprintf(lines[n++], sizeof(lines[0]), "xruns %lu  EAGAIN waits %lu  write errors %lu",
+             atomic_load(&audio_stats.xruns), atomic_load(&audio_stats.eagain_waits), atomic_load(&audio_stats.write_errors));
+    LatencyHistogram *histograms[] = {&audio_stats.write, &audio_stats.wakeup_jitter, &audio_stats.read, &audio_stats.fill};
+    for (size_t i = 0; i < sizeof(histograms) / sizeof(histograms[0]); i++) {
+        LatencyHistogram *h = histograms[i];
+        snprintf(lines[n++], sizeof(lines[0]), "%-14s p50 %7lu us  p99 %7lu us  max %7lu us", h->name,
+                 histogram_percentile(h, 0.5), histogram_percentile(h, 0.99), atomic_load(&h->max_us));
+    }
+    int max_y, max_x;
+    getmaxyx(win, max_y, max_x);
+    int actual_width = (max_x < FILE_LIST_FIXED_WIDTH) ? max_x : FILE_LIST_FIXED_WIDTH;
+    int start_y = max_y - 5 - n;
+    if (start_y < 4) return;
+    clear_rect(win, start_y + 1, start_y + 1 + n, 1, actual_width - 1);
+    draw_single_frame(win, start_y, n + 2, "DEBUG", 0);
+    for (int i = 0; i < n; i++) mvwprintw(win, start_y + 1 + i, 2, "%.*s", actual_width - 4, lines[i]);
+    wrefresh(win);
+}
+
+void load_playlist(const char *dir_path, PlayerControl *control) {
+with_mutex(control, action_set_stop_playlist, NULL, 1);
+    usleep(100000);
+    show_error = 0;
+    error_msg[0] = '\0';
+with_mutex(control, action_set_stop, NULL, 1);
+struct LoadMainData data = {dir_path};
+with_mutex(control, action_load_main, &data, 0);
+}
+
+static void action_quit(PlayerControl *control) {
+    control->quit = 1;
+}
+
+void shutdown_player_thread(PlayerControl *control, pthread_t thread, int *have_player_thread) {
+    if (!*have_player_thread) return;
+    lock_and_signal(control, action_quit);
+    int has_active_file = 0;
+SAFE_MUTEX_LOCK(&control->mutex);
+    has_active_file = (control->current_filename != NULL);
+    pthread_mutex_unlock(&control->mutex);
+if (has_active_file) {
+        int joined = 0;
+        time_t start = time(NULL);
+        while (!joined && (time(NULL) - start < 3)) {
+            int kill_ret = pthread_kill(thread, 0);
+            if (kill_ret == ESRCH) {
+                joined = 1;
+            } else if (kill_ret == 0) {
+                usleep(100000);
+            }
+        }
+        if (!joined) {
+            pthread_detach(thread);
+            fflush(stderr);
+        }
+    } else {
+        pthread_join(thread, NULL);
+    }
+}
+
+void action_p(PlayerControl *control)
+{
+    if (!control->current_file) {
+        display_message(STATUS, "Nothing to pause");
+        return;
+    }
+    if (control->paused) {
+        control->paused = 0;
+        control->is_silent = 0;
+        control->fading_in = 1;
+        control->current_fade = 0;
+        control->fading_out = 0;//
+        display_message(STATUS, "RESUMED (smooth fade-in)");
+    } else {
+        control->paused = 1;
+        display_message(STATUS, "PAUSED");
+    }
+}
+
+void action_toggle_shuffle(PlayerControl *control) {
+    control->shuffle_mode = !control->shuffle_mode;
+    if (control->playlist_mode && control->playlist) {
+        if (control->shuffle_mode) {
+            playlist_shuffle(control->playlist, control->current_track);
+            control->order_pos = 0;
+        } else {
+            control->order_pos = control->current_track;
+        }
+    }
+    display_message(STATUS, "%s", control->shuffle_mode ? "Shuffle enabled" : "Shuffle disabled");
+}
+
+void action_cycle_fade_curve(PlayerControl *control) {
+    control->fade_curve = (control->fade_curve + 1) % FADE_CURVES;
+    display_message(STATUS, "Fade curve: %s (%d ms)", fade_curve_names[control->fade_curve], FADE_MS);
+}
+
+void action_ab_loop(PlayerControl *control) {
+    if (!control->current_file) {
+        display_message(STATUS, "Nothing to loop");
+        return;
+    }
+    long long pos = control->bytes_read / FRAME_SIZE - control->delay_frames;
+    if (pos < 0) pos = 0;
+    char a[32], b[32];
+    if (control->loop_b >= 0) {
+        control->loop_a = -1;
+        control->loop_b = -1;
+        display_message(STATUS, "A-B loop cleared");
+    } else if (control->loop_a < 0) {
+        control->loop_a = pos;
+        format_frame_time(a, sizeof(a), pos);
+        display_message(STATUS, "Loop point A at %s, press A again to set B", a);
+    } else if (pos <= control->loop_a) {
+        display_message(ERROR, "Loop point B must be after A");
+    } else {
+        control->loop_b = pos;
+        control->loop_b_pending = 1;
+        format_frame_time(a, sizeof(a), control->loop_a);
+        format_frame_time(b, sizeof(b), pos);
+        display_message(STATUS, "A-B loop %s - %s", a, b);
+    }
+}
+
+static void adjust_crossfade(PlayerControl *control, int delta_ms) {
+    int value = control->crossfade_ms + delta_ms;
+    if (value < 0) value = 0;
+    if (value > CROSSFADE_MAX_MS) value = CROSSFADE_MAX_MS;
+    control->crossfade_ms = value;
+    if (value == 0) display_message(STATUS, "Crossfade disabled");
+    else display_message(STATUS, "Crossfade: %d s (equal-power)", value / 1000);
+}
+
+void action_crossfade_shorter(PlayerControl *control) {
+    adjust_crossfade(control, -CROSSFADE_STEP_MS);
+}
+
+void action_crossfade_longer(PlayerControl *control) {
+    adjust_crossfade(control, CROSSFADE_STEP_MS);
+}
+
+void action_toggle_repeat(PlayerControl *control) {
+    control->repeat_all = !control->repeat_all;
+    display_message(STATUS, "%s", control->repeat_all ? "Repeat all enabled" : "Repeat all disabled");
+}
+
+void action_seek(PlayerControl *control, int delta, const char *msg_if_none) {
+    if (control->current_file) {
+        control->seek_delta = delta;
+    } else {
+        display_message(STATUS, "%s", msg_if_none);
+    }
+}
+
+static void fade_in_on_start(void) {
+    SAFE_MUTEX_LOCK(&player_control.mutex);
+    player_control.fading_out = 0;
+    player_control.is_silent = 0;
+    player_control.fade_in_pending = 1;
+    pthread_mutex_unlock(&player_control.mutex);
+}
+
+static void play_single_file(void) {
+    if (!next_file_to_play || !next_file_name_to_play) {
+        display_message(ERROR, "No file to play");
+        return;
+    }
+    SAFE_MUTEX_LOCK(&player_control.mutex);
+    SAFE_FREE(player_control.filename);
+    player_control.filename = strdup(next_file_to_play);
+    SAFE_FREE(player_control.current_filename);
+    player_control.current_filename = strdup(next_file_name_to_play);
+    if (player_control.handoff_file) fclose(player_control.handoff_file);
+    player_control.handoff_file = next_file_handoff;
+    assign_safe_strdup(&player_control.handoff_path, next_file_handoff ? next_file_to_play : NULL);
+    next_file_handoff = NULL;
+    player_control.stop = 0;
+    player_control.paused = 0;
+    pthread_cond_broadcast(&player_control.cond);
+    pthread_mutex_unlock(&player_control.mutex);
+    SAFE_FREE(next_file_to_play);
+    SAFE_FREE(next_file_name_to_play);
+}
+
+void action_next_prev(PlayerControl *control, int direction) {
+    (void)control;
+    if (file_count == 0) return;
+    const char *current_full_path = NULL;
+    const char *current_playing = NULL;
+    SAFE_MUTEX_LOCK(&player_control.mutex);
+    if (player_control.current_filename) {
+        current_full_path = player_control.current_filename;
+        const char *slash = strrchr(current_full_path, '/');
+        current_playing = slash ? slash + 1 : current_full_path;
+    }
+    pthread_mutex_unlock(&player_control.mutex);
+    if (!current_playing) {
+        display_message(ERROR, "Nothing is playing");
+        return;
+    }
+    int playing_idx = -1;
+    for (int i = 0; i < file_count; i++) {
+        if (file_list[i].name && !file_list[i].is_dir &&
+            strcmp(file_list[i].name, current_playing) == 0) {
+            playing_idx = i;
+            break;
+        }
+    }
+    if (playing_idx == -1) {
+        display_message(ERROR, "Current file '%s' not found in list", current_playing);
+        return;
+    }
+    int next_idx = -1;
+    if (direction == 1) {
+        for (int i = playing_idx + 1; i < file_count; i++) {
+            if (!file_list[i].is_dir && is_raw_file(file_list[i].name)) {
+                next_idx = i;
+                break;
+            }
+        }
+        if (next_idx == -1) {
+            for (int i = 0; i < file_count; i++) {
+                if (!file_list[i].is_dir && is_raw_file(file_list[i].name)) {
+                    next_idx = i;
+                    break;
+                }
+            }
+        }
+    } else {
+        for (int i = playing_idx - 1; i >= 0; i--) {
+            if (!file_list[i].is_dir && is_raw_file(file_list[i].name)) {
+                next_idx = i;
+                break;
+            }
+        }
+        if (next_idx == -1) {
+            for (int i = file_count - 1; i >= 0; i--) {
+                if (!file_list[i].is_dir && is_raw_file(file_list[i].name)) {
+                    next_idx = i;
+                    break;
+                }
+            }
+        }
+    }
+    if (next_idx == -1) {
+        display_message(ERROR, "No more .raw files");
+        return;
+    }
+    lock_and_signal(&player_control, action_s);
+    usleep(80000);
+    char *full_path = xasprintf("%s/%s", current_dir, file_list[next_idx].name);
+    if (!full_path) {
+        display_message(ERROR, "Out of memory");
+        return;
+    }
+    SAFE_FREE(next_file_to_play);
+    SAFE_FREE(next_file_name_to_play);
+    next_file_to_play = strdup(full_path);
+    next_file_name_to_play = strdup(file_list[next_idx].name);
+    free(full_path);
+    if (!next_file_to_play || !next_file_name_to_play) {
+        SAFE_FREE(next_file_to_play);
+        SAFE_FREE(next_file_name_to_play);
+        display_message(ERROR, "Out of memory");
+        return;
+    }
+    fade_in_on_start();
+    play_single_file();
+    display_message(STATUS, "%s: %s", direction == 1 ? "Next" : "Previous", file_list[next_idx].name);
+}
+
+void action_s(PlayerControl *control) {
+    control->playlist_generation++;
+    if (control->current_file && control->current_filename && !control->paused) {
+        control->fading_out = 1;
+        control->current_fade = FADE_FRAMES;
+        control->is_silent = 0;
+        control->stop = 0;
+        display_message(STATUS, "Fading before stopping...");
+    } else {
+        control->stop = 1;
+        control->duration = 0.0;
+        control->bytes_read = 0LL;
+        show_error = 0;
+        error_msg[0] = '\0';
+        if (control->current_filename) {
+            free(control->current_filename);
+            control->current_filename = NULL;
+        }
+        control->paused = 0;
+        control->fading_out = 0;
+        cleanup_playlist(control);
+        control->playlist_mode = 0;
+        control->current_track = 0;
+        display_message(STATUS, "Playback stopped");
+    }
+}
+
+void lock_and_signal(PlayerControl *control, void (*action)(PlayerControl *)) {
+    pthread_mutex_lock(&control->mutex);
+    if (action) action(control);
+    pthread_cond_broadcast(&control->cond);
+    pthread_mutex_unlock(&control->mutex);
+}
+
+void lock_and_signal_seek(PlayerControl *control, int delta, const char *msg) {
+    SAFE_MUTEX_LOCK(&player_control.mutex);
+    action_seek(control, delta, msg);
+    pthread_cond_broadcast(&control->cond);
+    pthread_mutex_unlock(&control->mutex);
+}
+
+static void start_playback(const char *full_path, const char *file_name, int enable_loop) {
+    if (!full_path || !file_name) return;
+    show_error = 0;
+    error_msg[0] = '\0';
+    char msg[256];
+    FILE *hovered = NULL;
+    int check = hover_take(full_path, &hovered, msg, sizeof(msg));
+    if (check == HOVER_MISS) check = check_raw_file(full_path, file_name, msg, sizeof(msg));
+    if (check < 0) {
+        display_message(ERROR, "%s", msg);
+        return;
+    }
+    if (check > 0) display_message(STATUS, "%s", msg);
+    SAFE_FREE(next_file_to_play);
+    SAFE_FREE(next_file_name_to_play);
+    next_file_to_play = strdup(full_path);
+    next_file_name_to_play = strdup(file_name);
+    if (!next_file_to_play || !next_file_name_to_play) {
+        SAFE_FREE(next_file_to_play);
+        SAFE_FREE(next_file_name_to_play);
+        if (hovered) fclose(hovered);
+        display_message(ERROR, "Out of memory! Cannot play file.");
+        return;
+    }
+    next_file_handoff = hovered;
+    pthread_mutex_lock(&player_control.mutex);
+    cleanup_playlist(&player_control);
+    player_control.loop_mode = enable_loop;
+    player_control.paused = 0;
+    player_control.is_silent = 0;
+    player_control.fading_in = 0;
+    player_control.fading_out = 0;
+    player_control.current_fade = FADE_FRAMES;
+    player_control.bytes_read = 0LL;
+    player_control.duration = 0.0;
+    player_control.seek_delta = 0;
+    player_control.seek_target = -1;
+    player_control.fade_in_pending = 1;
+    player_control.start_pending = 1;
+    clock_gettime(CLOCK_MONOTONIC, &player_control.start_requested);
+    pthread_cond_broadcast(&player_control.cond);
+    pthread_mutex_unlock(&player_control.mutex);
+    play_single_file();
+    if (enable_loop) {
+        display_message(STATUS, "Playback started in loop mode on new file");
+    } else {
+        display_message(STATUS, "Playback started (smooth fade-in)");
+    }
+}
+
+int navigate_dir(const char *target_dir, char *status_buf)
+{
+    if (!target_dir || !status_buf) return -1;
+
+    if (chdir(target_dir) == 0) {
+        if (getcwd(current_dir, PATH_MAX) == NULL) {
+            display_message(ERROR, "getcwd failed - path may be too long");
+            return -1;
+        }
+        update_file_list();
+        status_buf[0] = '\0';
+        return 0;
+    } else {
+   display_message(ERROR, ACCESS_DENIED_MSG, target_dir);
+        return -1;
+    }
+}
+
+int navigate_and_play(void) {
+    init_ncurses("en_US.UTF-8");
+    curs_set(0);
+    clearok(stdscr, TRUE);
+    idlok(stdscr, TRUE);
+    scrollok(stdscr, FALSE);
+    getmaxyx(stdscr, term_height, term_width);
+    draw_single_frame(stdscr, 0, term_height, "GRANNIK | COMPLEX SOFTWARE ECOSYSTEM | FILE NAVIGATOR RAW", 1);
+    wnoutrefresh(stdscr);
+    doupdate();
+
+    if (term_width < MIN_WIDTH || term_height < MIN_HEIGHT) {
+        endwin();
+        return -1;
+    }
+    list_win = newwin(term_height - 2, INNER_WIDTH, 1, 1);
+    if (!list_win) { endwin(); return -1; }
+	wtimeout(list_win, 50);
+	wtimeout(stdscr, 50);
+    keypad(list_win, TRUE);
+    set_escdelay(25);
+
+    if (getcwd(current_dir, PATH_MAX) == NULL) {
+        delwin(list_win); endwin(); return -1;
+    }
+forward_history = malloc(forward_capacity * sizeof(char *));
+if (!forward_history) {
+fprintf(stderr, "Error: not enough memory for navigation history — function disabled\n");
+    forward_capacity = 0;
+    forward_count = 0;
+} else {
+    memset(forward_history, 0, forward_capacity * sizeof(char *));
+}
+strncpy(root_dir, current_dir, sizeof(root_dir) - 2);
+root_dir[sizeof(root_dir) - 2] = '\0';
+if (root_dir[0] != '\0' && root_dir[strlen(root_dir) - 1] != '/') {
+    strcat(root_dir, "/");
+}
+    free_forward_history();
+    update_file_list();
+    draw_file_list(list_win);
+    refresh();
+    hover_start();
+    listing_start();
+static int help_mode = 0;
+static int help_start_index = 0;
+int ch;
+	while (1) {
+	    hover_update();
+	    listing_update();
+	    ch = wgetch(list_win);
+	    if (ch != ERR) trace_event("command", 'i', ch);
+if (help_mode) {
+    if (ch == KEY_SR || ch == KEY_UP) {
+        if (help_start_index > 0)
+            help_start_index--;
+        continue;
+    }
+    if (ch == KEY_SF || ch == KEY_DOWN) {
+        int max_y = getmaxy(list_win);
+        int visible_lines = max_y - 6;
+        int help_count = total_help_lines_global;
+        if (help_start_index < help_count - visible_lines)
+            help_start_index++;
+        continue;
+    }
+    if (ch == 'h' || ch == 'H') {
+        help_mode = 0;
+        continue;
+    }
+}
+if (show_status && (time(NULL) - status_start_time >= STATUS_DURATION_SECONDS)) {
+    show_status = 0;
+    status_msg[0] = '\0';
+    draw_main_view(list_win);
+}
+	    if (ch == ERR) {
+		        if (trace_dump_requested) trace_dump_report();
+		        recursive_load_poll();
+		        m3u_load_poll();
+		        if (search_mode)
+		            search_update_status();
+		        if (help_mode)
+		            draw_help(list_win, help_start_index);
+		        else
+		            draw_main_view(list_win);
+		        continue;
+    }
+    if (search_mode && !help_mode && handle_search_key(ch)) continue;
+	if (ch != 10) {
+	    show_error = 0;
+	    error_msg[0] = '\0';
+	    show_status = 0;
+	    status_msg[0] = '\0';
+	}
+    strcpy(status_msg, "");
+    if (ch == 'q' || ch == 'Q') break;
+    switch (ch) {
+case KEY_UP:
+case KEY_DOWN:
+    if (file_count > 0) {
+        if (ch == KEY_UP) {
+            if (selected_index > 0) {
+                selected_index--;
+            } else {
+                selected_index = file_count - 1;
+            }
+        } else {
+            if (selected_index < file_count - 1) {
+                selected_index++;
+            } else {
+                selected_index = 0;
+            }
+        }
+    }
+    break;
+case KEY_LEFT:
+case KEY_RIGHT:
+    {
+        if (ch == KEY_LEFT) {
+            if (strcmp(current_dir, "/") == 0) {
+                display_message(STATUS, "Already at filesystem root");
+                break;
+            }
+
+            char temp_path[PATH_MAX];
+            strncpy(temp_path, current_dir, sizeof(temp_path)-1);
+            temp_path[sizeof(temp_path)-1] = '\0';
+
+            char *last_slash = strrchr(temp_path, '/');
+            if (last_slash == temp_path) {
+                strcpy(temp_path, "/");
+            } else if (last_slash) {
+                *last_slash = '\0';
+            }
+            if (add_to_forward(current_dir) == 0) {
+                if (navigate_dir(temp_path, status_msg) == 0) {
+                } else {
+                    if (forward_count > 0) {
+                        SAFE_FREE(forward_history[forward_count - 1]);
+                        forward_history[forward_count - 1] = NULL;
+                        forward_count--;
+                    }
+                }
+            } else {
+                display_message(STATUS, "Cannot save forward history");
+            }
+        } else {
+            if (forward_count > 0) {
+                char *next_dir = forward_history[forward_count - 1];
+                if (navigate_dir(next_dir, status_msg) == 0) {
+                    free(forward_history[forward_count - 1]);
+                    forward_history[forward_count - 1] = NULL;
+                    forward_count--;
+                }
+            } else {
+                display_message(STATUS, "No forward history");
+            }
+        }
+        break;
+    }
+        case 10:
+	            if (file_count > 0 && selected_index >= 0 && file_list && file_list[selected_index].name) {
+                if (!file_list[selected_index].is_dir) {
+                    if (is_raw_file(file_list[selected_index].name)) {
+                        char *full_path = xasprintf("%s/%s", current_dir, file_list[selected_index].name);
+                        if (!full_path) {
+                            display_message(STATUS, "Out of memory! Cannot play file.");
+                            break;
+                        }
+                        start_playback(full_path, file_list[selected_index].name, 0);
+                        free(full_path);
+                    } else if (is_m3u_file(file_list[selected_index].name)) {
+                        char *full_path = xasprintf("%s/%s", current_dir, file_list[selected_index].name);
+                        if (!full_path) {
+                            display_message(STATUS, "Out of memory! Cannot load playlist.");
+                            break;
+                        }
+                        load_playlist_m3u(full_path);
+                        free(full_path);
+                    } else {
+                        display_message(ERROR, "Not a .raw or .m3u file");
+                    }
+	                } else {
+   int dir_fd = openat(AT_FDCWD, file_list[selected_index].name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (dir_fd == -1) {
+display_message(ERROR, ACCESS_DENIED_MSG, xasprintf("%s/%s", current_dir, file_list[selected_index].name));
+        break;
+    }
+    struct stat st;
+    if (fstat(dir_fd, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        display_message(ERROR, "Not a directory or state changed: %s/%s", current_dir, file_list[selected_index].name);
+        close(dir_fd);
+        break;
+    }
+    if (fchdir(dir_fd) != 0) {
+display_message(ERROR, ACCESS_DENIED_MSG, xasprintf("%s/%s", current_dir, file_list[selected_index].name));
+        close(dir_fd);
+        break;
+    }
+                    close(dir_fd);
+	                    char old_dir[PATH_MAX];
+                    SAFE_STRNCPY(old_dir, current_dir, sizeof(old_dir));
+                    old_dir[sizeof(old_dir)-1] = '\0';
+	                    if (getcwd(current_dir, PATH_MAX) == NULL) {
+	                        display_message(STATUS, "getcwd failed after fchdir");
 	                        char fallback_path[PATH_MAX];
 	                        if (snprintf(fallback_path, sizeof(fallback_path), "%s/%s", old_dir, file_list[selected_index].name) < (int)sizeof(fallback_path)) {
 	                            char normalized_fallback[PATH_MAX];
@@ -2215,154 +6343,1622 @@ case 'b': {
     lock_and_signal_seek(&player_control, delta, msg);
     break;
 }
-case 's':
-lock_and_signal(&player_control, action_s);
-break;
-case 'h':
-    help_mode = !help_mode;
-    break;
-case ' ':
-    if (file_count > 0 && selected_index >= 0 && file_list && file_list[selected_index].name && file_list[selected_index].is_dir) {
-        char *full_path = xasprintf("%s/%s", current_dir, file_list[selected_index].name);
-        if (!full_path) {
-            display_message(STATUS, "Out of memory!");
-        } else {
-            load_playlist(full_path, &player_control);
-            free(full_path);
-            if (player_control.playlist_size == 0) {
-                display_message(ERROR, "Directory does not contain raw files.");
-            } else {
-                display_message(STATUS, "Playlist loaded from %s", file_list[selected_index].name);
-            }
+case 's':
+lock_and_signal(&player_control, action_s);
+break;
+case 'h':
+    help_mode = !help_mode;
+    break;
+case 'z':
+    lock_and_signal(&player_control, action_toggle_shuffle);
+    break;
+case 'r':
+    lock_and_signal(&player_control, action_toggle_repeat);
+    break;
+case '/':
+    search_prompt_and_start();
+    break;
+case ' ':
+    if (file_count > 0 && selected_index >= 0 && file_list && file_list[selected_index].name && file_list[selected_index].is_dir) {
+        char *full_path = xasprintf("%s/%s", current_dir, file_list[selected_index].name);
+        if (!full_path) {
+            display_message(STATUS, "Out of memory!");
+        } else {
+            load_playlist(full_path, &player_control);
+            free(full_path);
+            if (player_control.playlist_size == 0) {
+                display_message(ERROR, "Directory does not contain raw files.");
+            } else {
+                display_message(STATUS, "Playlist loaded from %s (%d tracks, %.0f B/track)", file_list[selected_index].name,
+                                player_control.playlist_size, playlist_bytes_per_track(player_control.playlist));
+            }
+        }
+    } else {
+        load_playlist(current_dir, &player_control);
+        if (player_control.playlist_size == 0) {
+            display_message(ERROR, "No .raw files in current directory.");
+        } else {
+            display_message(STATUS, "Playlist loaded from current directory (%d tracks, %.0f B/track)",
+                            player_control.playlist_size, playlist_bytes_per_track(player_control.playlist));
+        }
+    }
+    break;
+case 'w':
+    save_playlist_prompt();
+    break;
+case 'e':
+    enqueue_selected();
+    break;
+case 'E':
+    enqueue_marked();
+    break;
+case 'm':
+    toggle_mark_selected();
+    break;
+case 'c':
+    lock_and_signal(&player_control, action_clear_queue);
+    break;
+case 'd':
+    debug_overlay = !debug_overlay;
+    break;
+case 'C':
+    lock_and_signal(&player_control, action_cycle_fade_curve);
+    break;
+case 'A':
+    lock_and_signal(&player_control, action_ab_loop);
+    break;
+case 'T':
+    trace_dump_report();
+    break;
+case '[':
+    lock_and_signal(&player_control, action_crossfade_shorter);
+    break;
+case ']':
+    lock_and_signal(&player_control, action_crossfade_longer);
+    break;
+case 'R':
+    if (file_count > 0 && selected_index >= 0 && file_list && file_list[selected_index].name && file_list[selected_index].is_dir) {
+        char *full_path = xasprintf("%s/%s", current_dir, file_list[selected_index].name);
+        if (!full_path) {
+            display_message(STATUS, "Out of memory!");
+        } else {
+            load_playlist_recursive(full_path);
+            free(full_path);
+        }
+    } else {
+        load_playlist_recursive(current_dir);
+    }
+    break;
+	case 'l':
+	{
+	    int different = 0;
+	    const char *selected_name = NULL;
+	    pthread_mutex_lock(&player_control.mutex);
+	    if (file_count > 0 && selected_index >= 0 && file_list && file_list[selected_index].name &&
+	        !file_list[selected_index].is_dir && is_raw_file(file_list[selected_index].name)) {
+	        selected_name = file_list[selected_index].name;
+	        different = selected_name &&
+	            (!player_control.current_filename || strcmp(player_control.current_filename, selected_name) != 0);
+	    }
+	    pthread_mutex_unlock(&player_control.mutex);
+	    if (different && selected_name) {
+	        char *full_path = xasprintf("%s/%s", current_dir, selected_name);
+	        if (full_path) {
+	            start_playback(full_path, selected_name, 1);
+	            free(full_path);
+	        } else {
+	            display_message(STATUS, "Out of memory! Cannot play file.");
+	        }
+	    } else {
+	        pthread_mutex_lock(&player_control.mutex);
+	        if (player_control.current_file || player_control.filename) {
+	            player_control.loop_mode = !player_control.loop_mode;
+	            display_message(STATUS, "%s", player_control.loop_mode ? "Loop mode enabled" : "Loop mode disabled");
+	        } else {
+	            display_message(STATUS, "Nothing to loop");
+	        }
+	        pthread_mutex_unlock(&player_control.mutex);
+	    }
+	    break;
+	}
+case KEY_SLEFT:
+case KEY_SRIGHT: {
+    int delta = (ch == KEY_SLEFT) ? -5 : 5;
+    path_visual_offset += delta;
+    if (path_visual_offset < 0) path_visual_offset = 0;
+    break;
+}
+	case 'n':
+	case 'N':
+	{
+	    int dir = (ch == 'n') ? 1 : -1;
+	    SAFE_MUTEX_LOCK(&player_control.mutex);
+	    action_next_prev(&player_control, dir);
+	    pthread_mutex_unlock(&player_control.mutex);
+	    break;
+	}
+}
+}
+refresh_ui();
+		if (show_status && ch != ERR) {
+		    show_status = 0;
+		}
+    search_clear();
+    hover_stop();
+    listing_stop();
+    recursive_load_free(recursive_load);
+    m3u_load_free(m3u_load);
+    recursive_load = NULL;
+    if (list_win) {
+        delwin(list_win);
+        list_win = NULL;
+    }
+    endwin();
+    free_file_list();
+    free_forward_history();
+    return 0;
+}
+
+static int try_start_player_thread(pthread_t *thread,
+                                   void *(*func)(void *),
+                                   void *arg)
+{
+if (pthread_create(thread, NULL, func, arg) == 0) {
+    return 1;
+}
+fprintf(stderr, "pthread_create failed — player disabled\n");
+    return 0;
+}
+
+static void handle_program_exit(
+    int result,
+    int was_playing,
+    int hours,
+    int mins,
+    int secs
+) {
+    if (result == 0) {
+        endwin_and_clear_screen();
+
+        if (was_playing) {
+            printf(
+                "\033[31mWARNING: Audio thread did not finish in 3s — "
+                "interrupted at %02d:%02d:%02d — "
+                "leaving it (safer than pthread_cancel)\033[0m\n",
+                hours, mins, secs
+            );
+        } else {
+            printf(" END\n");
+        }
+    } else {
+        printf(
+            "\033[31m Terminal too small! Minimum: %dx%d\033[0m\n",
+            MIN_WIDTH, MIN_HEIGHT
+        );
+    }
+}
+
+static volatile sig_atomic_t headless_interrupted = 0;
+
+static void headless_signal(int sig) {
+    (void)sig;
+    headless_interrupted = 1;
+}
+
+static void headless_field(const char *key, const char *value) {
+    char quoted[PATH_MAX * 4 + 3];
+    quote_value(quoted, sizeof(quoted), value);
+    fprintf(stderr, " %s=%s", key, quoted);
+}
+
+static void headless_message(const char *event, const char *msg) {
+    fprintf(stderr, "event=%s", event);
+    headless_field("msg", msg);
+    fputc('\n', stderr);
+}
+
+static int headless_enqueue_files(int count, char **files) {
+    char **paths = calloc(count, sizeof(char *));
+    if (!paths) {
+        headless_message("error", "Out of memory");
+        return 1;
+    }
+    int valid = 0;
+    int errors = 0;
+    char msg[256];
+    for (int i = 0; i < count; i++) {
+        const char *slash = strrchr(files[i], '/');
+        int check = check_raw_file(files[i], slash ? slash + 1 : files[i], msg, sizeof(msg));
+        if (check < 0) {
+            headless_message("error", msg);
+            errors++;
+            continue;
+        }
+        if (check > 0) headless_message("status", msg);
+        paths[valid] = safe_strdup(files[i]);
+        if (!paths[valid]) break;
+        valid++;
+    }
+    if (valid == 0) free(paths);
+    else enqueue_paths(paths, valid);
+    return errors;
+}
+
+static int headless_start(int argc, char *argv[]) {
+    if (strcmp(argv[0], "--play") == 0) return headless_enqueue_files(argc - 1, argv + 1);
+    struct stat st;
+    char resolved[PATH_MAX];
+    if (argc != 2) {
+        headless_message("error", "--playlist takes exactly one directory or M3U file");
+        return 1;
+    }
+    if (stat(argv[1], &st) != 0 || !realpath(argv[1], resolved)) {
+        char msg[PATH_MAX + 64];
+        snprintf(msg, sizeof(msg), ACCESS_DENIED_MSG, argv[1]);
+        headless_message("error", msg);
+        return 1;
+    }
+    if (S_ISDIR(st.st_mode)) load_playlist(resolved, &player_control);
+    else load_playlist_m3u(resolved);
+    return 0;
+}
+
+static int run_headless(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: tapraw [--sink=SPEC] --play FILE... | --playlist DIR|LIST.m3u\n");
+        return 2;
+    }
+    signal(SIGINT, headless_signal);
+    signal(SIGTERM, headless_signal);
+    int errors = 0;
+    int tracks = 0;
+    char track_path[PATH_MAX] = "";
+    char last_status[sizeof(status_msg)] = "";
+    double track_pos = 0.0;
+    struct timespec last_progress = {0};
+    pthread_mutex_lock(&player_control.mutex);
+    track_events.enabled = 1;
+    pthread_mutex_unlock(&player_control.mutex);
+    if (render_output) {
+        pthread_mutex_lock(&player_control.mutex);
+        player_control.fade_in_pending = 1;
+        player_control.fade_out_at_end = 1;
+        pthread_mutex_unlock(&player_control.mutex);
+    }
+    errors += headless_start(argc, argv);
+    while (!headless_interrupted) {
+        if (trace_dump_requested) trace_dump_report();
+        if (show_error) {
+            show_error = 0;
+            headless_message("error", error_msg);
+            errors++;
+        }
+        m3u_load_poll();
+        if (show_status) {
+            show_status = 0;
+            if (strcmp(last_status, status_msg) != 0) headless_message("status", status_msg);
+            SAFE_STRNCPY(last_status, status_msg, sizeof(last_status));
+        }
+        pthread_mutex_lock(&player_control.mutex);
+        double pos = (double)player_control.bytes_read / BYTES_PER_SECOND;
+        double duration = player_control.duration;
+        int idle = !player_control.current_filename && !player_control.filename && player_control.queue_count == 0 &&
+                   !player_control.playlist_loading && !m3u_load;
+        if (idle) track_event_finish();
+        TrackEvent *events = track_events.items;
+        int event_count = track_events.count;
+        track_events.items = NULL;
+        track_events.count = track_events.capacity = 0;
+        pthread_mutex_unlock(&player_control.mutex);
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        for (int i = 0; i < event_count; i++) {
+            const char *path = events[i].path ? events[i].path : "";
+            if (events[i].finished) {
+                fprintf(stderr, "event=finish track=%d", tracks);
+                track_path[0] = '\0';
+            } else {
+                tracks++;
+                SAFE_STRNCPY(track_path, path, sizeof(track_path));
+                fprintf(stderr, "event=start track=%d duration=%.3f", tracks, events[i].duration);
+                last_progress = now;
+            }
+            headless_field("file", path);
+            fputc('\n', stderr);
+            free(events[i].path);
+        }
+        free(events);
+        if (track_path[0] && event_count == 0 && (now.tv_sec - last_progress.tv_sec) * 1000 +
+            (now.tv_nsec - last_progress.tv_nsec) / 1000000 >= 1000) {
+            fprintf(stderr, "event=progress track=%d pos=%.3f duration=%.3f\n", tracks, pos, duration);
+            last_progress = now;
+        }
+        if (track_path[0]) track_pos = pos;
+        if (idle) break;
+        usleep(render_output ? 1000 : 100000);
+    }
+    if (headless_interrupted) {
+        fprintf(stderr, "event=interrupted track=%d pos=%.3f\n", tracks, track_pos);
+        return 130;
+    }
+    if (tracks == 0 && errors == 0) {
+        headless_message("error", "Nothing to play");
+        errors++;
+    }
+    fprintf(stderr, "event=end tracks=%d errors=%d\n", tracks, errors);
+    return errors ? 1 : 0;
+}
+
+typedef struct DaemonClient {
+    int fd;
+    int slot;
+    size_t length;
+    char line[DAEMON_LINE_MAX];
+} DaemonClient;
+
+static int daemon_reply(DaemonClient *client, const char *fmt, ...) __attribute__((format(printf,2,3)));
+
+static int daemon_reply(DaemonClient *client, const char *fmt, ...) {
+    char reply[DAEMON_LINE_MAX + 16];
+    va_list ap;
+    va_start(ap, fmt);
+    int length = vsnprintf(reply, sizeof(reply) - 1, fmt, ap);
+    va_end(ap);
+    if (length < 0) return -1;
+    if (length > (int)sizeof(reply) - 2) length = (int)sizeof(reply) - 2;
+    reply[length++] = '\n';
+    return send(client->fd, reply, length, MSG_NOSIGNAL | MSG_DONTWAIT) == length ? 0 : -1;
+}
+
+static int daemon_status(DaemonClient *client) {
+    PlayerStatus status;
+    status_read(&status);
+    char quoted[PATH_MAX * 4 + 3];
+    quote_value(quoted, sizeof(quoted), status.path);
+    return daemon_reply(client, "ok state=%s pos=%.3f duration=%.3f track=%llu queue=%d peak=%.1f file=%s",
+                        !status.playing ? "stopped" : status.paused ? "paused" : "playing",
+                        (double)status.bytes_read / BYTES_PER_SECOND, status.duration, (unsigned long long)status.track_starts,
+                        status.queue_count, 20.0 * log10((status.level_peak + 1) / 32768.0), quoted);
+}
+
+static void action_pause_only(PlayerControl *control) {
+    if (!control->paused && control->current_filename) action_p(control);
+}
+
+static void action_resume_only(PlayerControl *control) {
+    if (control->paused) action_p(control);
+}
+
+static int daemon_command(DaemonClient *client, char *line) {
+    trace_event("command", 'i', line[0]);
+    char *arg = line + strcspn(line, " \t");
+    if (*arg) *arg++ = '\0';
+    arg += strspn(arg, " \t");
+    char msg[256];
+    if (strcmp(line, "status") == 0) return daemon_status(client);
+    if (strcmp(line, "play") == 0 || strcmp(line, "queue") == 0) {
+        if (!*arg) return daemon_reply(client, "error %s needs a file", line);
+        const char *slash = strrchr(arg, '/');
+        if (check_raw_file(arg, slash ? slash + 1 : arg, msg, sizeof(msg)) < 0) return daemon_reply(client, "error %s", msg);
+        if (line[0] == 'p') {
+            start_playback(arg, slash ? slash + 1 : arg, 0);
+            return daemon_reply(client, "ok");
+        }
+        char **paths = malloc(sizeof(char *));
+        if (!paths || !(paths[0] = safe_strdup(arg))) {
+            free(paths);
+            return daemon_reply(client, "error out of memory");
+        }
+        enqueue_paths(paths, 1);
+        return daemon_reply(client, "ok");
+    }
+    if (strcmp(line, "seek") == 0) {
+        char *end;
+        long seconds = strtol(arg, &end, 10);
+        if (!*arg || *end) return daemon_reply(client, "error seek takes [+|-]SECONDS");
+        if (arg[0] != '+' && arg[0] != '-') {
+            pthread_mutex_lock(&player_control.mutex);
+            if (player_control.current_file) {
+                player_control.seek_delta = 0;
+                player_control.seek_target = seconds < 0 ? 0 : (long long)seconds * BYTES_PER_SECOND;
+            }
+            pthread_cond_broadcast(&player_control.cond);
+            pthread_mutex_unlock(&player_control.mutex);
+        } else if (seconds != 0) {
+            lock_and_signal_seek(&player_control, (int)seconds, "Nothing to seek");
+        }
+        return daemon_reply(client, "ok");
+    }
+    if (strcmp(line, "pause") == 0 || strcmp(line, "resume") == 0 || strcmp(line, "stop") == 0) {
+        lock_and_signal(&player_control, line[0] == 's' ? action_s : line[0] == 'p' ? action_pause_only : action_resume_only);
+        return daemon_reply(client, "ok");
+    }
+    if (strcmp(line, "quit") == 0) {
+        headless_interrupted = 1;
+        return daemon_reply(client, "ok");
+    }
+    return daemon_reply(client, "error unknown command: %s", line);
+}
+
+static void render_report(const char *path, const struct timespec *begin) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    struct stat st;
+    if (stat(path, &st) != 0) return;
+    size_t len = strlen(path);
+    long long bytes = st.st_size - ((len > 4 && strcasecmp(path + len - 4, ".wav") == 0) ? 44 : 0);
+    double seconds = (double)bytes / BYTES_PER_SECOND;
+    double elapsed = (end.tv_sec - begin->tv_sec) + (end.tv_nsec - begin->tv_nsec) / 1e9;
+    fprintf(stderr, "event=render frames=%lld seconds=%.3f elapsed=%.3f realtime=%.1f", bytes / FRAME_SIZE, seconds,
+            elapsed, elapsed > 0 ? seconds / elapsed : 0.0);
+    headless_field("file", path);
+    fputc('\n', stderr);
+}
+
+static DaemonClient *daemon_clients[DAEMON_MAX_CLIENTS];
+
+static void daemon_drop(int epoll_fd, DaemonClient *client) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    daemon_clients[client->slot] = NULL;
+    free(client);
+}
+
+static int daemon_read(DaemonClient *client) {
+    for (;;) {
+        ssize_t got = recv(client->fd, client->line + client->length, sizeof(client->line) - client->length, 0);
+        if (got == 0) return -1;
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        client->length += got;
+        char *start = client->line;
+        char *newline;
+        while ((newline = memchr(start, '\n', client->line + client->length - start))) {
+            *newline = '\0';
+            if (newline > start && newline[-1] == '\r') newline[-1] = '\0';
+            if (*start && daemon_command(client, start) != 0) return -1;
+            start = newline + 1;
+        }
+        client->length -= start - client->line;
+        memmove(client->line, start, client->length);
+        if (client->length == sizeof(client->line)) {
+            daemon_reply(client, "error line too long");
+            return -1;
+        }
+    }
+}
+
+static int daemon_listen(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    SAFE_STRNCPY(addr.sun_path, path, sizeof(addr.sun_path));
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "Refusing to replace %s: not a socket\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    mode_t old_mask = umask(0077);
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound != 0 || listen(fd, DAEMON_MAX_CLIENTS) != 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int run_daemon(const char *option) {
+    char path[PATH_MAX];
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    if (strncmp(option, "--daemon=", 9) == 0) SAFE_STRNCPY(path, option + 9, sizeof(path));
+    else if (runtime && *runtime) snprintf(path, sizeof(path), "%s/tapraw.sock", runtime);
+    else snprintf(path, sizeof(path), "/tmp/tapraw-%u.sock", (unsigned)getuid());
+    int listen_fd = daemon_listen(path);
+    if (listen_fd < 0) return 1;
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) != 0) {
+        perror("epoll");
+        close(listen_fd);
+        unlink(path);
+        return 1;
+    }
+    signal(SIGINT, headless_signal);
+    signal(SIGTERM, headless_signal);
+    fprintf(stderr, "event=listen");
+    headless_field("socket", path);
+    fputc('\n', stderr);
+    char last_status[sizeof(status_msg)] = "";
+    struct epoll_event events[DAEMON_MAX_CLIENTS];
+    while (!headless_interrupted) {
+        int ready = epoll_wait(epoll_fd, events, DAEMON_MAX_CLIENTS, 250);
+        if (ready < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < ready; i++) {
+            DaemonClient *client = events[i].data.ptr;
+            if (client) {
+                if (daemon_read(client) != 0) daemon_drop(epoll_fd, client);
+                continue;
+            }
+            int fd;
+            while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                int slot = 0;
+                while (slot < DAEMON_MAX_CLIENTS && daemon_clients[slot]) slot++;
+                client = slot < DAEMON_MAX_CLIENTS ? calloc(1, sizeof(DaemonClient)) : NULL;
+                ev.events = EPOLLIN;
+                ev.data.ptr = client;
+                if (!client || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                    free(client);
+                    close(fd);
+                    continue;
+                }
+                client->fd = fd;
+                client->slot = slot;
+                daemon_clients[slot] = client;
+            }
+        }
+        if (trace_dump_requested) trace_dump_report();
+        if (show_error) {
+            show_error = 0;
+            headless_message("error", error_msg);
+        }
+        if (show_status) {
+            show_status = 0;
+            if (strcmp(last_status, status_msg) != 0) headless_message("status", status_msg);
+            SAFE_STRNCPY(last_status, status_msg, sizeof(last_status));
+        }
+    }
+    for (int i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+        if (daemon_clients[i]) daemon_drop(epoll_fd, daemon_clients[i]);
+    }
+    close(epoll_fd);
+    close(listen_fd);
+    unlink(path);
+    fprintf(stderr, "event=shutdown\n");
+    return 0;
+}
+
+static int handle_initial_directory(int argc, char *argv[]) {
+	if (argc > 1) {
+	    if (argv[1] == NULL) {
+fprintf(stderr, "Invalid directory argument (NULL)\n");
+	        return -1;
+	    }
+	    if (chdir(argv[1]) != 0) {
+	            display_message(ERROR, "Failed to change to directory: %s", argv[1]);
+	            return -1;
+	        }
+	    }
+	    return 0;
+	}
+
+#define KERNEL_BENCH_FRAMES 4096
+#define KERNEL_BENCH_ROUNDS 20000
+
+static void gain_ramp_s16_legacy(int16_t *samples, int frames, float gain, float step) {
+    for (int i = 0; i < frames * CHANNELS; i++) {
+        float g = gain + (float)(i / CHANNELS) * step;
+        samples[i] = (int16_t)(samples[i] * g);
+    }
+}
+
+static double kernel_bench_run(GainRampFn fn, int16_t *samples) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < KERNEL_BENCH_ROUNDS; r++) {
+        fn(samples, KERNEL_BENCH_FRAMES, 1.0f, 0.0f);
+        __asm__ __volatile__("" : : "r"(samples) : "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    return (double)KERNEL_BENCH_ROUNDS * KERNEL_BENCH_FRAMES * CHANNELS / ns;
+}
+
+static int run_kernel_bench(void) {
+    int16_t *samples = malloc((size_t)KERNEL_BENCH_FRAMES * FRAME_SIZE);
+    SAFE_RETURN_IF_NULL(samples, 1);
+    printf("gain ramp, %d frames x %d rounds\n", KERNEL_BENCH_FRAMES, KERNEL_BENCH_ROUNDS);
+    double base = 0.0;
+    for (int v = -1; v < KERNEL_VARIANT_COUNT; v++) {
+        if (v >= 0 && !kernel_variant_supported(&kernel_variants[v])) continue;
+        for (int i = 0; i < KERNEL_BENCH_FRAMES * CHANNELS; i++) samples[i] = (int16_t)((i * 7919) & 0xFFFF);
+        double rate = kernel_bench_run(v < 0 ? gain_ramp_s16_legacy : kernel_variants[v].gain_ramp_s16, samples);
+        if (v < 0) base = rate;
+        printf("  %-8s %8.3f samples/ns  %6.2fx\n", v < 0 ? "legacy" : kernel_variants[v].name, rate, rate / base);
+    }
+    printf("active: %s\n", kernels.name);
+    free(samples);
+    return 0;
+}
+
+#define KERNEL_CHECK_SAMPLES 4099
+
+static int kernel_check_variant(const SampleKernels *variant) {
+    const SampleKernels *ref = &kernel_variants[0];
+    int16_t *in = malloc(KERNEL_CHECK_SAMPLES * sizeof(int16_t));
+    int16_t *other = malloc(KERNEL_CHECK_SAMPLES * sizeof(int16_t));
+    int16_t *a = malloc(KERNEL_CHECK_SAMPLES * sizeof(int16_t));
+    int16_t *b = malloc(KERNEL_CHECK_SAMPLES * sizeof(int16_t));
+    float *fa = malloc(KERNEL_CHECK_SAMPLES * sizeof(float));
+    float *fb = malloc(KERNEL_CHECK_SAMPLES * sizeof(float));
+    int failures = 0;
+    if (!in || !other || !a || !b || !fa || !fb) {
+        failures = -1;
+        goto out;
+    }
+    unsigned int seed = 12345;
+    for (int i = 0; i < KERNEL_CHECK_SAMPLES; i++) {
+        in[i] = (int16_t)(rand_r(&seed) & 0xFFFF);
+        other[i] = (int16_t)(rand_r(&seed) & 0xFFFF);
+    }
+    in[0] = INT16_MIN;
+    in[1] = INT16_MAX;
+    for (int round = 0; round < 64; round++) {
+        int count = 1 + rand_r(&seed) % KERNEL_CHECK_SAMPLES;
+        int frames = count / CHANNELS;
+        float gain = (float)(rand_r(&seed) % 2048) / 1024.0f;
+        float step = (float)((int)(rand_r(&seed) % 2001) - 1000) / 1e6f;
+        memcpy(a, in, count * sizeof(int16_t));
+        memcpy(b, in, count * sizeof(int16_t));
+        ref->gain_ramp_s16(a, frames, gain, step);
+        variant->gain_ramp_s16(b, frames, gain, step);
+        failures += memcmp(a, b, count * sizeof(int16_t)) != 0;
+        memcpy(a, in, count * sizeof(int16_t));
+        memcpy(b, in, count * sizeof(int16_t));
+        ref->mix_s16(a, other, count);
+        variant->mix_s16(b, other, count);
+        failures += memcmp(a, b, count * sizeof(int16_t)) != 0;
+        ref->s16_to_f32(fa, in, count);
+        variant->s16_to_f32(fb, in, count);
+        failures += memcmp(fa, fb, count * sizeof(float)) != 0;
+        for (int i = 0; i < count; i++) fa[i] *= gain * 1.5f;
+        ref->f32_to_s16(a, fa, count);
+        variant->f32_to_s16(b, fa, count);
+        failures += memcmp(a, b, count * sizeof(int16_t)) != 0;
+        int peak_a, peak_b;
+        uint64_t sum_a, sum_b;
+        ref->peak_rms_s16(in, count, &peak_a, &sum_a);
+        variant->peak_rms_s16(in, count, &peak_b, &sum_b);
+        failures += peak_a != peak_b || sum_a != sum_b;
+    }
+out:
+    free(in);
+    free(other);
+    free(a);
+    free(b);
+    free(fa);
+    free(fb);
+    return failures;
+}
+
+static int run_cpu_features(void) {
+    printf("cpu:");
+#if defined(__x86_64__) || defined(__i386__)
+#define PRINT_CPU_FEATURE(f) printf(" %s%s", __builtin_cpu_supports(f) ? "+" : "-", f)
+    PRINT_CPU_FEATURE("sse2");
+    PRINT_CPU_FEATURE("sse4.1");
+    PRINT_CPU_FEATURE("avx");
+    PRINT_CPU_FEATURE("avx2");
+    PRINT_CPU_FEATURE("fma");
+    PRINT_CPU_FEATURE("avx512f");
+#undef PRINT_CPU_FEATURE
+#else
+    printf(" (no x86 runtime detection)");
+#endif
+    printf("\n");
+    int failed = 0;
+    for (int v = 0; v < KERNEL_VARIANT_COUNT; v++) {
+        const SampleKernels *variant = &kernel_variants[v];
+        if (!kernel_variant_supported(variant)) {
+            printf("  %-8s unsupported\n", variant->name);
+            continue;
+        }
+        int failures = kernel_check_variant(variant);
+        printf("  %-8s %s%s\n", variant->name,
+               failures == 0 ? "matches scalar" : (failures < 0 ? "check skipped: out of memory" : "MISMATCH"),
+               strcmp(variant->name, kernels.name) == 0 ? "  [active]" : "");
+        if (failures != 0) failed = 1;
+    }
+    printf("kernels: gain_ramp_s16 mix_s16 s16_to_f32 f32_to_s16 peak_rms_s16\n");
+    return failed;
+}
+
+#define BENCH_MAX_RESULTS 32
+#define BENCH_MIN_NS 200000000ULL
+#define BENCH_SORT_ENTRIES 10000
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) || __has_feature(memory_sanitizer)
+#define TAPRAW_SANITIZED 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define TAPRAW_SANITIZED 1
+#endif
+
+#if defined(TAPRAW_BENCH_ALLOCS) && defined(__GLIBC__) && !defined(TAPRAW_SANITIZED)
+#define BENCH_COUNTS_ALLOCS 1
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+static atomic_int bench_alloc_counting;
+static atomic_ulong bench_alloc_count;
+
+static inline void bench_count_alloc(void) {
+    if (atomic_load_explicit(&bench_alloc_counting, memory_order_relaxed))
+        atomic_fetch_add_explicit(&bench_alloc_count, 1, memory_order_relaxed);
+}
+
+void *malloc(size_t size) {
+    bench_count_alloc();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    bench_count_alloc();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    bench_count_alloc();
+    return __libc_realloc(ptr, size);
+}
+#else
+#define BENCH_COUNTS_ALLOCS 0
+#endif
+
+typedef struct BenchResult {
+    char name[48];
+    const char *unit;
+    long long ops;
+    double ns_per_op;
+    double allocs_per_op;
+    double bytes_per_op;
+} BenchResult;
+
+typedef void (*BenchFn)(void *ctx, long long iterations);
+
+static BenchResult bench_results[BENCH_MAX_RESULTS];
+static int bench_result_count;
+static const char *bench_filter;
+static FILE *bench_output;
+
+static uint64_t bench_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static int bench_selected(const char *name) {
+    return !headless_interrupted && (!bench_filter || strstr(name, bench_filter) != NULL);
+}
+
+static void bench_run(const char *name, const char *unit, BenchFn fn, void *ctx, long long ops_per_iteration) {
+    if (!bench_selected(name) || bench_result_count == BENCH_MAX_RESULTS) return;
+    long long iterations = 1;
+    uint64_t elapsed = 0;
+    unsigned long allocs = 0;
+    off_t bytes = -1;
+    for (;;) {
+        if (bench_output) {
+            fflush(bench_output);
+            if (ftruncate(fileno(bench_output), 0) == 0) rewind(bench_output);
+        }
+#if BENCH_COUNTS_ALLOCS
+        atomic_store(&bench_alloc_count, 0);
+        atomic_store(&bench_alloc_counting, 1);
+#endif
+        uint64_t begin = bench_now_ns();
+        fn(ctx, iterations);
+        elapsed = bench_now_ns() - begin;
+#if BENCH_COUNTS_ALLOCS
+        atomic_store(&bench_alloc_counting, 0);
+        allocs = atomic_load(&bench_alloc_count);
+#endif
+        if (bench_output) {
+            fflush(bench_output);
+            bytes = lseek(fileno(bench_output), 0, SEEK_CUR);
+        }
+        if (elapsed >= BENCH_MIN_NS || iterations >= (1LL << 40) || headless_interrupted) break;
+        iterations *= elapsed > 0 && BENCH_MIN_NS / elapsed < 2 ? 2 : (elapsed > 0 ? (long long)(BENCH_MIN_NS / elapsed) + 1 : 100);
+    }
+    BenchResult *result = &bench_results[bench_result_count++];
+    long long ops = iterations * ops_per_iteration;
+    SAFE_STRNCPY(result->name, name, sizeof(result->name));
+    result->unit = unit;
+    result->ops = ops;
+    result->ns_per_op = (double)elapsed / ops;
+    result->allocs_per_op = BENCH_COUNTS_ALLOCS ? (double)allocs / ops : -1.0;
+    result->bytes_per_op = bytes >= 0 ? (double)bytes / ops : -1.0;
+    printf("  %-34s %12.2f ns/%-7s", name, result->ns_per_op, unit);
+    if (result->allocs_per_op >= 0) printf(" %8.3f allocs/%s", result->allocs_per_op, unit);
+    else printf("      n/a allocs");
+    if (result->bytes_per_op >= 0) printf(" %10.1f bytes/%s", result->bytes_per_op, unit);
+    printf("\n");
+    fflush(stdout);
+}
+
+typedef struct BenchTree {
+    char path[PATH_MAX];
+    int entries;
+} BenchTree;
+
+static int bench_tree_entry(const BenchTree *tree, int index, char *out, size_t size) {
+    int len = snprintf(out, size, "%s/%s%07d%s", tree->path, index % 3 ? "track_" : "Запись_", index, index % 20 ? ".raw" : "");
+    return len > 0 && (size_t)len < size ? 0 : -1;
+}
+
+static int bench_tree_create(BenchTree *tree, int entries) {
+    const char *tmp = getenv("TMPDIR");
+    snprintf(tree->path, sizeof(tree->path), "%s/tapraw-bench-XXXXXX", tmp && *tmp ? tmp : "/tmp");
+    tree->entries = 0;
+    if (!mkdtemp(tree->path)) return -1;
+    char path[PATH_MAX];
+    for (int i = 0; i < entries; i++) {
+        if (headless_interrupted) {
+            errno = EINTR;
+            return -1;
+        }
+        if (bench_tree_entry(tree, i, path, sizeof(path)) != 0) return -1;
+        int fd = i % 20 ? open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644) : mkdir(path, 0755);
+        if (fd < 0) return -1;
+        if (i % 20) close(fd);
+        tree->entries++;
+    }
+    return 0;
+}
+
+static void bench_tree_remove(BenchTree *tree) {
+    char path[PATH_MAX];
+    for (int i = 0; i < tree->entries; i++) {
+        if (bench_tree_entry(tree, i, path, sizeof(path)) != 0) break;
+        if (i % 20) unlink(path);
+        else rmdir(path);
+    }
+    rmdir(tree->path);
+}
+
+static void bench_scan_directory(void *ctx, long long iterations) {
+    BenchTree *tree = ctx;
+    for (long long i = 0; i < iterations; i++) {
+        void *entries = NULL;
+        int count = 0;
+        if (scan_directory(tree->path, 0, &entries, &count, 0) == 0) free_names(entries, count, 1);
+    }
+}
+
+static void bench_convert_to_wchar(void *ctx, long long iterations) {
+    for (long long i = 0; i < iterations; i++) {
+        wchar_t *wide = NULL;
+        size_t length = 0;
+        convert_to_wchar(ctx, &wide, &length);
+        free(wide);
+    }
+}
+
+static void bench_prepare_display(void *ctx, long long iterations) {
+    wchar_t dest[256];
+    for (long long i = 0; i < iterations; i++) {
+        prepare_display_wstring(ctx, 30, dest, 256, 0, L"..", 0, 1);
+        __asm__ __volatile__("" : : "r"(dest) : "memory");
+    }
+}
+
+static int16_t bench_samples[KERNEL_BENCH_FRAMES * CHANNELS];
+static int16_t bench_other[KERNEL_BENCH_FRAMES * CHANNELS];
+static float bench_floats[KERNEL_BENCH_FRAMES * CHANNELS];
+
+static void bench_apply_fade(void *ctx, long long iterations) {
+    PlayerControl *control = ctx;
+    for (long long i = 0; i < iterations; i++) {
+        control->current_fade = 0;
+        apply_fade(control, 1, (char *)bench_samples, KERNEL_BENCH_FRAMES * FRAME_SIZE);
+    }
+}
+
+static void bench_gain_ramp(void *ctx, long long iterations) {
+    (void)ctx;
+    for (long long i = 0; i < iterations; i++) kernels.gain_ramp_s16(bench_samples, KERNEL_BENCH_FRAMES, 1.0f, 0.0f);
+}
+
+static void bench_mix(void *ctx, long long iterations) {
+    (void)ctx;
+    for (long long i = 0; i < iterations; i++) kernels.mix_s16(bench_samples, bench_other, KERNEL_BENCH_FRAMES * CHANNELS);
+}
+
+static void bench_s16_to_f32(void *ctx, long long iterations) {
+    (void)ctx;
+    for (long long i = 0; i < iterations; i++) kernels.s16_to_f32(bench_floats, bench_samples, KERNEL_BENCH_FRAMES * CHANNELS);
+}
+
+static void bench_f32_to_s16(void *ctx, long long iterations) {
+    (void)ctx;
+    for (long long i = 0; i < iterations; i++) kernels.f32_to_s16(bench_samples, bench_floats, KERNEL_BENCH_FRAMES * CHANNELS);
+}
+
+static void bench_peak_rms(void *ctx, long long iterations) {
+    (void)ctx;
+    int peak;
+    uint64_t sum;
+    for (long long i = 0; i < iterations; i++) kernels.peak_rms_s16(bench_samples, KERNEL_BENCH_FRAMES * CHANNELS, &peak, &sum);
+    __asm__ __volatile__("" : : "r"(peak), "r"(sum));
+}
+
+typedef struct BenchSort {
+    void *source;
+    void *work;
+    size_t count;
+    size_t size;
+    int (*cmp)(const void *, const void *);
+} BenchSort;
+
+static void bench_qsort(void *ctx, long long iterations) {
+    BenchSort *sort = ctx;
+    for (long long i = 0; i < iterations; i++) {
+        memcpy(sort->work, sort->source, sort->count * sort->size);
+        qsort(sort->work, sort->count, sort->size, sort->cmp);
+    }
+}
+
+static int bench_write_json(const char *path, const char *tool) {
+    FILE *out = fopen(path, "w");
+    if (!out) return -1;
+    fprintf(out, "{\n  \"tool\": \"tapraw %s\",\n  \"timestamp\": %ld,\n  \"kernels\": \"%s\",\n  \"results\": [\n",
+            tool, (long)time(NULL), kernels.name);
+    for (int i = 0; i < bench_result_count; i++) {
+        BenchResult *r = &bench_results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"unit\": \"%s\", \"ops\": %lld, \"ns_per_op\": %.3f, \"allocs_per_op\": ",
+                r->name, r->unit, r->ops, r->ns_per_op);
+        if (r->allocs_per_op >= 0) fprintf(out, "%.4f", r->allocs_per_op);
+        else fprintf(out, "null");
+        if (r->bytes_per_op >= 0) fprintf(out, ", \"bytes_per_op\": %.1f", r->bytes_per_op);
+        fprintf(out, "}");
+        fprintf(out, "%s\n", i + 1 < bench_result_count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    return fclose(out);
+}
+
+static void bench_init(void) {
+    if (!setlocale(LC_ALL, "") || MB_CUR_MAX == 1) setlocale(LC_ALL, "C.UTF-8");
+    sample_kernels_init();
+    fade_tables_init();
+    printf("kernels: %s%s\n", kernels.name, BENCH_COUNTS_ALLOCS ? "" : "  (allocations not counted: build with -DTAPRAW_BENCH_ALLOCS)");
+}
+
+static int bench_finish(const char *json_path, const char *tool) {
+    if (!json_path) return 0;
+    if (bench_write_json(json_path, tool) != 0) {
+        fprintf(stderr, "Cannot write %s: %s\n", json_path, strerror(errno));
+        return 1;
+    }
+    printf("results written to %s\n", json_path);
+    return 0;
+}
+
+static int run_bench(const char *option, int argc, char *argv[]) {
+    const char *json_path = NULL;
+    int large = option && strcmp(option, "scan_1m") == 0;
+    if (option && !large) {
+        fprintf(stderr, "Usage: tapraw --bench[=scan_1m] [FILTER] [--json=PATH]\n");
+        return 2;
+    }
+    for (int i = 0; i < argc; i++) {
+        if (strncmp(argv[i], "--json=", 7) == 0) json_path = argv[i] + 7;
+        else bench_filter = argv[i];
+    }
+    signal(SIGINT, headless_signal);
+    signal(SIGTERM, headless_signal);
+    bench_init();
+
+    static const int tree_sizes[] = {1000, 100000, 1000000};
+    static const char *tree_names[] = {"scan_directory/1k", "scan_directory/100k", "scan_directory/1M"};
+    for (int t = 0; t < (large ? 3 : 2); t++) {
+        if (!bench_selected(tree_names[t])) continue;
+        BenchTree tree;
+        if (bench_tree_create(&tree, tree_sizes[t]) != 0) {
+            if (!headless_interrupted)
+                fprintf(stderr, "Cannot create %d-entry tree in %s: %s\n", tree_sizes[t], tree.path, strerror(errno));
+            bench_tree_remove(&tree);
+            continue;
         }
+        bench_run(tree_names[t], "entry", bench_scan_directory, &tree, tree.entries);
+        bench_tree_remove(&tree);
+    }
+
+    static const struct { const char *script; const char *name; } names[] = {
+        {"ascii", "Some Artist - A Fairly Long Track Title (Remastered 2011).raw"},
+        {"cyrillic", "Исполнитель — Довольно длинное название трека (ремастеринг).raw"},
+        {"cjk", "アーティスト - とても長い曲のタイトル（リマスター版）二〇一一年.raw"},
+    };
+    char bench_name[48];
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        snprintf(bench_name, sizeof(bench_name), "convert_to_wchar/%s", names[i].script);
+        bench_run(bench_name, "call", bench_convert_to_wchar, (void *)names[i].name, 1);
+        snprintf(bench_name, sizeof(bench_name), "prepare_display_wstring/%s", names[i].script);
+        bench_run(bench_name, "call", bench_prepare_display, (void *)names[i].name, 1);
+    }
+
+    unsigned int seed = 2024;
+    for (int i = 0; i < KERNEL_BENCH_FRAMES * CHANNELS; i++) {
+        bench_samples[i] = (int16_t)(rand_r(&seed) & 0xFFFF);
+        bench_other[i] = (int16_t)(rand_r(&seed) & 0xFFFF);
+        bench_floats[i] = bench_samples[i] / 32768.0f;
+    }
+    PlayerControl fade_control = {.fade_curve = 1};
+    bench_run("apply_fade", "frame", bench_apply_fade, &fade_control, KERNEL_BENCH_FRAMES);
+    bench_run("kernel/gain_ramp_s16", "frame", bench_gain_ramp, NULL, KERNEL_BENCH_FRAMES);
+    bench_run("kernel/mix_s16", "sample", bench_mix, NULL, KERNEL_BENCH_FRAMES * CHANNELS);
+    bench_run("kernel/s16_to_f32", "sample", bench_s16_to_f32, NULL, KERNEL_BENCH_FRAMES * CHANNELS);
+    bench_run("kernel/f32_to_s16", "sample", bench_f32_to_s16, NULL, KERNEL_BENCH_FRAMES * CHANNELS);
+    bench_run("kernel/peak_rms_s16", "sample", bench_peak_rms, NULL, KERNEL_BENCH_FRAMES * CHANNELS);
+
+    FileEntry *entries = calloc(BENCH_SORT_ENTRIES, sizeof(FileEntry));
+    FileEntry *entries_work = calloc(BENCH_SORT_ENTRIES, sizeof(FileEntry));
+    char **paths = calloc(BENCH_SORT_ENTRIES, sizeof(char *));
+    char **paths_work = calloc(BENCH_SORT_ENTRIES, sizeof(char *));
+    int sorted = entries && entries_work && paths && paths_work;
+    for (int i = 0; sorted && i < BENCH_SORT_ENTRIES; i++) {
+        unsigned key = rand_r(&seed);
+        entries[i].name = xasprintf("%s %u.raw", names[key % 3].name, key);
+        entries[i].is_dir = key % 20 == 0;
+        paths[i] = xasprintf("/music/library/%s", entries[i].name ? entries[i].name : "");
+        sorted = entries[i].name && paths[i];
+    }
+    if (sorted) {
+        BenchSort by_entry = {entries, entries_work, BENCH_SORT_ENTRIES, sizeof(FileEntry), file_entry_cmp};
+        BenchSort by_path = {paths, paths_work, BENCH_SORT_ENTRIES, sizeof(char *), playlist_cmp};
+        snprintf(bench_name, sizeof(bench_name), "qsort/file_entry_cmp/%d", BENCH_SORT_ENTRIES);
+        bench_run(bench_name, "sort", bench_qsort, &by_entry, 1);
+        snprintf(bench_name, sizeof(bench_name), "qsort/playlist_cmp/%d", BENCH_SORT_ENTRIES);
+        bench_run(bench_name, "sort", bench_qsort, &by_path, 1);
     } else {
-        load_playlist(current_dir, &player_control);
-        if (player_control.playlist_size == 0) {
-            display_message(ERROR, "No .raw files in current directory.");
+        fprintf(stderr, "Out of memory preparing sort benchmarks\n");
+    }
+    if (entries) free_names(entries, BENCH_SORT_ENTRIES, 1);
+    if (paths) free_names(paths, BENCH_SORT_ENTRIES, 0);
+    free(entries_work);
+    free(paths_work);
+    if (headless_interrupted) return 130;
+    return bench_finish(json_path, "--bench");
+}
+
+#define TUI_BENCH_ENTRIES 2000
+#define TUI_BENCH_DIRS 40
+
+static void tui_bench_frame(void) {
+    draw_main_view(list_win);
+    wrefresh(list_win);
+}
+
+static void tui_bench_idle(void *ctx, long long iterations) {
+    (void)ctx;
+    for (long long i = 0; i < iterations; i++) tui_bench_frame();
+}
+
+static void tui_bench_scroll(void *ctx, long long iterations) {
+    (void)ctx;
+    for (long long i = 0; i < iterations; i++) {
+        selected_index = (selected_index + 1) % file_count;
+        tui_bench_frame();
+    }
+}
+
+static void tui_bench_progress(void *ctx, long long iterations) {
+    (void)ctx;
+    long long total = (long long)(player_control.duration * 176400.0);
+    for (long long i = 0; i < iterations; i++) {
+        player_control.bytes_read = (player_control.bytes_read + 8820) % total;
+        tui_bench_frame();
+    }
+}
+
+static void tui_bench_help(void *ctx, long long iterations) {
+    (void)ctx;
+    for (long long i = 0; i < iterations; i++) {
+        draw_help(list_win, (int)(i % (total_help_lines_global > 0 ? total_help_lines_global : 1)));
+        wrefresh(list_win);
+    }
+}
+
+static void tui_bench_list(int count, const char *file_format, const char *dir_format, int dir_every) {
+    free_file_list();
+    file_list = calloc((size_t)count, sizeof(FileEntry));
+    check_alloc(file_list);
+    for (int i = 0; i < count; i++) {
+        file_list[i].is_dir = dir_every > 0 && i % dir_every == 0;
+        file_list[i].name = xasprintf(file_list[i].is_dir ? dir_format : file_format, i);
+    }
+    file_count = count;
+    selected_index = 0;
+}
+
+static int run_tui_bench(int argc, char *argv[]) {
+    const char *json_path = NULL;
+    int rows = 40, cols = 100;
+    for (int i = 0; i < argc; i++) {
+        if (strncmp(argv[i], "--json=", 7) == 0) json_path = argv[i] + 7;
+        else if (strncmp(argv[i], "--size=", 7) == 0) sscanf(argv[i] + 7, "%dx%d", &rows, &cols);
+        else bench_filter = argv[i];
+    }
+    if (rows < MIN_HEIGHT || cols < MIN_WIDTH) {
+        fprintf(stderr, "Terminal size must be at least %dx%d\n", MIN_HEIGHT, MIN_WIDTH);
+        return 2;
+    }
+    bench_init();
+    const char *term = getenv("TERM");
+    if (!term || !*term || strcmp(term, "dumb") == 0) term = "xterm-256color";
+    FILE *input = fopen("/dev/null", "r");
+    bench_output = tmpfile();
+    SCREEN *screen = input && bench_output ? newterm(term, bench_output, input) : NULL;
+    if (!screen) {
+        fprintf(stderr, "Cannot open an off-screen %s terminal\n", term);
+        if (bench_output) fclose(bench_output);
+        if (input) fclose(input);
+        return 1;
+    }
+    printf("terminal: %s %dx%d\n", term, rows, cols);
+    resize_term(rows, cols);
+    curs_set(0);
+    init_color_pairs();
+    getmaxyx(stdscr, term_height, term_width);
+    draw_single_frame(stdscr, 0, term_height, "GRANNIK | COMPLEX SOFTWARE ECOSYSTEM | FILE NAVIGATOR RAW", 1);
+    wnoutrefresh(stdscr);
+    list_win = newwin(term_height - 2, INNER_WIDTH, 1, 1);
+    check_alloc(list_win);
+
+    SAFE_STRNCPY(current_dir, "/home/user/Music/Library/Collection", sizeof(current_dir));
+    tui_bench_list(TUI_BENCH_ENTRIES, "Artist %04d - Track Title (Album Version).raw", "Album %04d", 10);
+    bench_run("tui/idle", "frame", tui_bench_idle, NULL, 1);
+    bench_run("tui/cursor_scroll", "frame", tui_bench_scroll, NULL, 1);
+
+    char *playing = safe_strdup(file_list[7].name);
+    player_control.current_filename = playing;
+    player_control.duration = 300.0;
+    player_control.bytes_read = 0;
+    selected_index = 5;
+    bench_run("tui/progress_tick", "frame", tui_bench_progress, NULL, 1);
+    player_control.current_filename = NULL;
+    player_control.duration = 0.0;
+    player_control.bytes_read = 0;
+    free(playing);
+
+    BenchTree tree = {.entries = 0};
+    if (bench_selected("tui/playlist_highlight")) {
+        const char *tmp = getenv("TMPDIR");
+        snprintf(tree.path, sizeof(tree.path), "%s/tapraw-bench-XXXXXX", tmp && *tmp ? tmp : "/tmp");
+        if (mkdtemp(tree.path)) {
+            tui_bench_list(TUI_BENCH_DIRS, "", "Album %04d", 1);
+            char path[PATH_MAX];
+            for (int i = 0; i < file_count; i++) {
+                if (snprintf(path, sizeof(path), "%s/%s", tree.path, file_list[i].name) < (int)sizeof(path) && mkdir(path, 0755) == 0)
+                    tree.entries++;
+            }
+            SAFE_STRNCPY(current_dir, tree.path, sizeof(current_dir));
+            player_control.playlist_mode = 1;
+            player_control.playlist_dir = xasprintf("%s/%s", tree.path, file_list[3].name);
+            bench_run("tui/playlist_highlight", "frame", tui_bench_scroll, NULL, 1);
+            player_control.playlist_mode = 0;
+            SAFE_FREE(player_control.playlist_dir);
+            for (int i = 0; i < tree.entries; i++) {
+                if (snprintf(path, sizeof(path), "%s/%s", tree.path, file_list[i].name) < (int)sizeof(path)) rmdir(path);
+            }
+            rmdir(tree.path);
         } else {
-            display_message(STATUS, "Playlist loaded from current directory");
+            fprintf(stderr, "Cannot create %s: %s\n", tree.path, strerror(errno));
         }
     }
-    break;
-	case 'l':
-	{
-	    int different = 0;
-	    const char *selected_name = NULL;
-	    pthread_mutex_lock(&player_control.mutex);
-	    if (file_count > 0 && selected_index >= 0 && file_list && file_list[selected_index].name &&
-	        !file_list[selected_index].is_dir && is_raw_file(file_list[selected_index].name)) {
-	        selected_name = file_list[selected_index].name;
-	        different = selected_name &&
-	            (!player_control.current_filename || strcmp(player_control.current_filename, selected_name) != 0);
-	    }
-	    pthread_mutex_unlock(&player_control.mutex);
-	    if (different && selected_name) {
-	        char *full_path = xasprintf("%s/%s", current_dir, selected_name);
-	        if (full_path) {
-	            start_playback(full_path, selected_name, 1);
-	            free(full_path);
-	        } else {
-	            display_message(STATUS, "Out of memory! Cannot play file.");
-	        }
-	    } else {
-	        pthread_mutex_lock(&player_control.mutex);
-	        if (player_control.current_file || player_control.filename) {
-	            player_control.loop_mode = !player_control.loop_mode;
-	            display_message(STATUS, "%s", player_control.loop_mode ? "Loop mode enabled" : "Loop mode disabled");
-	        } else {
-	            display_message(STATUS, "Nothing to loop");
-	        }
-	        pthread_mutex_unlock(&player_control.mutex);
-	    }
-	    break;
-	}
-case KEY_SLEFT:
-case KEY_SRIGHT: {
-    int delta = (ch == KEY_SLEFT) ? -5 : 5;
-    path_visual_offset += delta;
-    if (path_visual_offset < 0) path_visual_offset = 0;
-    break;
+
+    SAFE_STRNCPY(current_dir, "/home/user/音楽/ライブラリ/アーティスト名がとても長いコレクション/二〇二四年のリマスター版アルバム/ディスク１", sizeof(current_dir));
+    tui_bench_list(TUI_BENCH_ENTRIES, "%04d アーティスト - とても長い曲のタイトル（リマスター版）二〇一一年 ライブ録音.raw", "%04d 長いアルバム名のフォルダ", 10);
+    bench_run("tui/cjk_paths", "frame", tui_bench_scroll, NULL, 1);
+
+    bench_run("tui/help_scroll", "frame", tui_bench_help, NULL, 1);
+
+    free_file_list();
+    delwin(list_win);
+    list_win = NULL;
+    endwin();
+    delscreen(screen);
+    fclose(bench_output);
+    bench_output = NULL;
+    fclose(input);
+    return bench_finish(json_path, "--bench-tui");
 }
-	case 'n':
-	case 'N':
-	{
-	    int dir = (ch == 'n') ? 1 : -1;
-	    SAFE_MUTEX_LOCK(&player_control.mutex);
-	    action_next_prev(&player_control, dir);
-	    pthread_mutex_unlock(&player_control.mutex);
-	    break;
-	}
+
+#define LATENCY_TRACKS 3
+#define LATENCY_TRACK_SECONDS 30
+#define LATENCY_MAX_SAMPLES 1024
+#define LATENCY_TIMEOUT_MS 3000
+
+static const char *latency_kind_names[LATENCY_KINDS] = {"play", "pause", "resume", "seek", "next"};
+
+typedef struct LatencySamples {
+    double delivered_ms[LATENCY_MAX_SAMPLES];
+    double audible_ms[LATENCY_MAX_SAMPLES];
+    int count;
+    int missed;
+} LatencySamples;
+
+static int latency_track_path(char *out, size_t size, const char *dir, int track) {
+    int len = snprintf(out, size, "%s/track_%d.raw", dir, track);
+    return len > 0 && (size_t)len < size ? 0 : -1;
 }
+
+static int write_test_tone(const char *path, long long frames) {
+    int16_t *samples = malloc((size_t)RATE * FRAME_SIZE);
+    SAFE_RETURN_IF_NULL(samples, -1);
+    for (int i = 0; i < RATE; i++) {
+        int16_t v = (int16_t)(8000.0 * sin(2.0 * M_PI * 441.0 * i / RATE));
+        samples[2 * i] = samples[2 * i + 1] = v;
+    }
+    int result = 0;
+    FILE *out = fopen(path, "wb");
+    for (long long done = 0; out && result == 0 && done < frames; done += RATE) {
+        size_t n = frames - done < RATE ? (size_t)(frames - done) : RATE;
+        if (fwrite(samples, FRAME_SIZE, n, out) != n) result = -1;
+    }
+    if (!out || fclose(out) != 0) result = -1;
+    free(samples);
+    return result;
 }
-refresh_ui();
-		if (show_status && ch != ERR) {
-		    show_status = 0;
-		}
-    if (list_win) {
-        delwin(list_win);
-        list_win = NULL;
+
+static int latency_create_tracks(const char *dir) {
+    char path[PATH_MAX];
+    for (int t = 0; t < LATENCY_TRACKS; t++) {
+        if (latency_track_path(path, sizeof(path), dir, t) != 0 ||
+            write_test_tone(path, (long long)LATENCY_TRACK_SECONDS * RATE) != 0) return -1;
     }
-    endwin();
-    free_file_list();
-    free_forward_history();
     return 0;
 }
 
-static int try_start_player_thread(pthread_t *thread,
-                                   void *(*func)(void *),
-                                   void *arg)
-{
-if (pthread_create(thread, NULL, func, arg) == 0) {
-    return 1;
+static void latency_remove_tracks(const char *dir) {
+    char path[PATH_MAX];
+    for (int t = 0; t < LATENCY_TRACKS; t++) {
+        if (latency_track_path(path, sizeof(path), dir, t) == 0) unlink(path);
+    }
+    rmdir(dir);
 }
-fprintf(stderr, "pthread_create failed — player disabled\n");
-    return 0;
+
+static int latency_key_kind(const char *key) {
+    if (strcmp(key, "enter") == 0) return LATENCY_PLAY;
+    if (strcmp(key, "p") == 0) {
+        SAFE_MUTEX_LOCK(&player_control.mutex);
+        int paused = player_control.paused;
+        pthread_mutex_unlock(&player_control.mutex);
+        return paused ? LATENCY_RESUME : LATENCY_PAUSE;
+    }
+    if (strcmp(key, "f") == 0 || strcmp(key, "b") == 0) return LATENCY_SEEK;
+    if (strcmp(key, "n") == 0 || strcmp(key, "N") == 0) return LATENCY_NEXT;
+    return -1;
 }
 
-static void handle_program_exit(
-    int result,
-    int was_playing,
-    int hours,
-    int mins,
-    int secs
-) {
-    if (result == 0) {
-        endwin_and_clear_screen();
+static void latency_key(const char *key) {
+    if (strcmp(key, "enter") == 0) {
+        char *full_path = xasprintf("%s/%s", current_dir, file_list[selected_index].name);
+        start_playback(full_path, file_list[selected_index].name, 0);
+        free(full_path);
+    } else if (strcmp(key, "p") == 0) {
+        lock_and_signal(&player_control, action_p);
+    } else if (strcmp(key, "f") == 0 || strcmp(key, "b") == 0) {
+        lock_and_signal_seek(&player_control, key[0] == 'f' ? 10 : -10, "Nothing to seek");
+    } else {
+        SAFE_MUTEX_LOCK(&player_control.mutex);
+        action_next_prev(&player_control, key[0] == 'n' ? 1 : -1);
+        pthread_mutex_unlock(&player_control.mutex);
+    }
+}
 
-        if (was_playing) {
-            printf(
-                "\033[31mWARNING: Audio thread did not finish in 3s — "
-                "interrupted at %02d:%02d:%02d — "
-                "leaving it (safer than pthread_cancel)\033[0m\n",
-                hours, mins, secs
-            );
-        } else {
-            printf(" END\n");
+static int latency_cmp(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double latency_percentile(double *values, int count, double fraction) {
+    if (count == 0) return 0.0;
+    qsort(values, (size_t)count, sizeof(double), latency_cmp);
+    int rank = (int)ceil(fraction * count);
+    return values[rank > 0 ? rank - 1 : 0];
+}
+
+static int latency_write_json(const char *path, LatencySamples *samples, int rounds, int gap_ms) {
+    FILE *out = fopen(path, "w");
+    if (!out) return -1;
+    fprintf(out, "{\n  \"tool\": \"tapraw --bench-latency\",\n  \"timestamp\": %ld,\n  \"sink\": \"%s\",\n  \"rounds\": %d,\n  \"gap_ms\": %d,\n  \"results\": [\n",
+            (long)time(NULL), sink_spec, rounds, gap_ms);
+    int first = 1;
+    for (int k = 0; k < LATENCY_KINDS; k++) {
+        LatencySamples *l = &samples[k];
+        if (l->count == 0 && l->missed == 0) continue;
+        fprintf(out, "%s    {\"command\": \"%s\", \"samples\": %d, \"missed\": %d, "
+                "\"delivered_ms\": {\"p50\": %.3f, \"p99\": %.3f}, \"audible_ms\": {\"p50\": %.3f, \"p99\": %.3f}}",
+                first ? "" : ",\n", latency_kind_names[k], l->count, l->missed,
+                latency_percentile(l->delivered_ms, l->count, 0.5), latency_percentile(l->delivered_ms, l->count, 0.99),
+                latency_percentile(l->audible_ms, l->count, 0.5), latency_percentile(l->audible_ms, l->count, 0.99));
+        first = 0;
+    }
+    fprintf(out, "\n  ]\n}\n");
+    return fclose(out);
+}
+
+static int run_latency_bench(int argc, char *argv[]) {
+    const char *json_path = NULL;
+    const char *script = "enter p p f n";
+    int rounds = 10, gap_ms = 500;
+    for (int i = 0; i < argc; i++) {
+        if (strncmp(argv[i], "--json=", 7) == 0) json_path = argv[i] + 7;
+        else if (strncmp(argv[i], "--script=", 9) == 0) script = argv[i] + 9;
+        else if (strncmp(argv[i], "--rounds=", 9) == 0) rounds = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--gap=", 6) == 0) gap_ms = atoi(argv[i] + 6);
+        else {
+            fprintf(stderr, "Usage: tapraw --bench-latency [--script=\"enter p p f n\"] [--rounds=N] [--gap=MS] [--json=PATH]\n");
+            return 2;
         }
-    } else {
-        printf(
-            "\033[31m Terminal too small! Minimum: %dx%d\033[0m\n",
-            MIN_WIDTH, MIN_HEIGHT
-        );
     }
+    char keys[64][8];
+    int key_count = 0;
+    char script_copy[512];
+    SAFE_STRNCPY(script_copy, script, sizeof(script_copy));
+    char *save = NULL;
+    for (char *key = strtok_r(script_copy, " ,", &save); key; key = strtok_r(NULL, " ,", &save)) {
+        if (latency_key_kind(key) < 0 || key_count == 64) {
+            fprintf(stderr, "Unknown key in script: %s (use enter, p, f, b, n, N)\n", key);
+            return 2;
+        }
+        SAFE_STRNCPY(keys[key_count], key, sizeof(keys[key_count]));
+        key_count++;
+    }
+    if (key_count == 0 || rounds < 1 || gap_ms < 1) {
+        fprintf(stderr, "Script, rounds and gap must not be empty\n");
+        return 2;
+    }
+
+    const char *tmp = getenv("TMPDIR");
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/tapraw-latency-XXXXXX", tmp && *tmp ? tmp : "/tmp");
+    if (!mkdtemp(dir) || latency_create_tracks(dir) != 0) {
+        fprintf(stderr, "Cannot create test tracks in %s: %s\n", dir, strerror(errno));
+        latency_remove_tracks(dir);
+        return 1;
+    }
+    SAFE_STRNCPY(current_dir, dir, sizeof(current_dir));
+    tui_bench_list(LATENCY_TRACKS, "track_%d.raw", "", 0);
+    signal(SIGINT, headless_signal);
+    signal(SIGTERM, headless_signal);
+
+    static LatencySamples samples[LATENCY_KINDS];
+    printf("sink: %s, script: \"%s\" x %d rounds, %d ms between keys\n", sink_spec, script, rounds, gap_ms);
+    for (int r = 0; r < rounds && !headless_interrupted; r++) {
+        for (int k = 0; k < key_count && !headless_interrupted; k++) {
+            int kind = latency_key_kind(keys[k]);
+            SAFE_MUTEX_LOCK(&player_control.mutex);
+            latency_probe.kind = kind;
+            latency_probe.baseline = latency_probe_progress(&player_control, kind);
+            atomic_store_explicit(&latency_probe.armed, 1, memory_order_release);
+            pthread_mutex_unlock(&player_control.mutex);
+            uint64_t pressed = monotonic_us();
+            latency_key(keys[k]);
+            uint64_t deadline = pressed + (uint64_t)(gap_ms > LATENCY_TIMEOUT_MS ? gap_ms : LATENCY_TIMEOUT_MS) * 1000u;
+            while (atomic_load_explicit(&latency_probe.armed, memory_order_acquire) && monotonic_us() < deadline && !headless_interrupted)
+                usleep(1000);
+            LatencySamples *l = &samples[kind];
+            if (atomic_exchange(&latency_probe.armed, 0)) {
+                l->missed++;
+            } else if (l->count < LATENCY_MAX_SAMPLES) {
+                l->delivered_ms[l->count] = (double)(latency_probe.delivered_us - pressed) / 1000.0;
+                l->audible_ms[l->count] = (double)(latency_probe.audible_us - pressed) / 1000.0;
+                l->count++;
+            }
+            uint64_t settle = pressed + (uint64_t)gap_ms * 1000u;
+            uint64_t now = monotonic_us();
+            if (now < settle) usleep((useconds_t)(settle - now));
+        }
+    }
+    lock_and_signal(&player_control, action_s);
+    lock_and_signal(&player_control, action_s);
+
+    printf("  %-8s %7s %6s %12s %12s %12s %12s\n", "command", "samples", "missed", "deliv p50", "deliv p99", "audible p50", "audible p99");
+    for (int k = 0; k < LATENCY_KINDS; k++) {
+        LatencySamples *l = &samples[k];
+        if (l->count == 0 && l->missed == 0) continue;
+        printf("  %-8s %7d %6d %9.1f ms %9.1f ms %9.1f ms %9.1f ms\n", latency_kind_names[k], l->count, l->missed,
+               latency_percentile(l->delivered_ms, l->count, 0.5), latency_percentile(l->delivered_ms, l->count, 0.99),
+               latency_percentile(l->audible_ms, l->count, 0.5), latency_percentile(l->audible_ms, l->count, 0.99));
+    }
+    free_file_list();
+    latency_remove_tracks(dir);
+    if (!json_path) return headless_interrupted ? 130 : 0;
+    if (latency_write_json(json_path, samples, rounds, gap_ms) != 0) {
+        fprintf(stderr, "Cannot write %s: %s\n", json_path, strerror(errno));
+        return 1;
+    }
+    printf("results written to %s\n", json_path);
+    return headless_interrupted ? 130 : 0;
 }
 
-static int handle_initial_directory(int argc, char *argv[]) {
-	if (argc > 1) {
-	    if (argv[1] == NULL) {
-fprintf(stderr, "Invalid directory argument (NULL)\n");
-	        return -1;
-	    }
-	    if (chdir(argv[1]) != 0) {
-	            display_message(ERROR, "Failed to change to directory: %s", argv[1]);
-	            return -1;
-	        }
-	    }
-	    return 0;
-	}
+typedef struct RenderCheck {
+    const char *name;
+    const char *args[6];
+    long long expect_frames;
+} RenderCheck;
+
+static const RenderCheck render_checks[] = {
+    {"single 1.5 s track", {"--play", "a.raw"}, 66150},
+    {"playlist of one 0.5 s track", {"--playlist", "short"}, 22050},
+    {"queue of three tracks", {"--play", "a.raw", "short/s.raw", "a.raw"}, 66150 + 22050 + 66150},
+    {"500 ms crossfade", {"--crossfade=500", "--play", "01.raw", "02.raw"}, 2 * 55125 - 22050},
+    {"500 ms crossfades over three tracks", {"--crossfade=500", "--play", "01.raw", "02.raw", "a.raw"}, 2 * 55125 + 66150 - 2 * 22050},
+};
+
+static int render_check_run(const char *dir, const RenderCheck *check, const char *output) {
+    char render_arg[PATH_MAX + 48];
+    snprintf(render_arg, sizeof(render_arg), "--render=%s", output);
+    const char *args[12] = {"tapraw", "--sink=null:fast", render_arg};
+    int n = 3;
+    for (int i = 0; i < 6 && check->args[i]; i++) args[n++] = check->args[i];
+    args[n] = NULL;
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+        }
+        if (chdir(dir) == 0) execv("/proc/self/exe", (char *const *)args);
+        _exit(127);
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int render_check_output(const char *output, long long expect_frames, char *detail, size_t size) {
+    FILE *in = fopen(output, "rb");
+    if (!in) {
+        snprintf(detail, size, "no output: %s", strerror(errno));
+        return 1;
+    }
+    int16_t frame[CHANNELS] = {0};
+    long long frames = 0;
+    int peak = 0;
+    while (fread(frame, FRAME_SIZE, 1, in) == 1) {
+        for (int c = 0; c < CHANNELS; c++) {
+            if (abs(frame[c]) > peak) peak = abs(frame[c]);
+        }
+        frames++;
+    }
+    fclose(in);
+    int last = abs(frame[0]) > abs(frame[1]) ? abs(frame[0]) : abs(frame[1]);
+    snprintf(detail, size, "%lld/%lld frames, peak %d, last %d", frames, expect_frames, peak, last);
+    return frames != expect_frames || peak == 0 || last > 2;
+}
+
+static int run_render_check(void) {
+    const char *tmp = getenv("TMPDIR");
+    char dir[PATH_MAX], path[PATH_MAX + 32], output[PATH_MAX + 32];
+    snprintf(dir, sizeof(dir), "%s/tapraw-check-XXXXXX", tmp && *tmp ? tmp : "/tmp");
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Cannot create %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/short", dir);
+    int ready = mkdir(path, 0755) == 0;
+    static const struct { const char *name; long long frames; } tones[] = {
+        {"a.raw", 66150}, {"short/s.raw", 22050}, {"01.raw", 55125}, {"02.raw", 55125},
+    };
+    for (size_t i = 0; ready && i < sizeof(tones) / sizeof(tones[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, tones[i].name);
+        ready = write_test_tone(path, tones[i].frames) == 0;
+    }
+    snprintf(output, sizeof(output), "%s/out.raw", dir);
+    int failed = !ready;
+    for (size_t i = 0; ready && i < sizeof(render_checks) / sizeof(render_checks[0]); i++) {
+        char detail[128] = "";
+        int rc = render_check_run(dir, &render_checks[i], output);
+        int bad = rc != 0 || render_check_output(output, render_checks[i].expect_frames, detail, sizeof(detail));
+        if (rc != 0) snprintf(detail, sizeof(detail), "exit status %d", rc);
+        printf("  %-36s %s  %s\n", render_checks[i].name, bad ? "FAIL" : "ok  ", detail);
+        failed |= bad;
+        unlink(output);
+    }
+    if (!ready) fprintf(stderr, "Cannot create test tracks in %s\n", dir);
+    for (size_t i = 0; i < sizeof(tones) / sizeof(tones[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, tones[i].name);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/short", dir);
+    rmdir(path);
+    rmdir(dir);
+    return failed;
+}
 
 int main(int argc, char *argv[]) {
-	if (argc > 1 && argv[1] != NULL) {
+	static char render_spec[PATH_MAX + 8];
+	for (; argc > 1 && argv[1] != NULL; argv++, argc--) {
+	    if (strncmp(argv[1], "--sink=", 7) == 0) {
+	        sink_spec = argv[1] + 7;
+	    } else if (strncmp(argv[1], "--render=", 9) == 0 && argv[1][9]) {
+	        render_output = argv[1] + 9;
+	    } else if (strncmp(argv[1], "--metrics=", 10) == 0 && argv[1][10]) {
+	        metrics_export.path = argv[1] + 10;
+	    } else if (strncmp(argv[1], "--metrics-interval=", 19) == 0) {
+	        int seconds = atoi(argv[1] + 19);
+	        metrics_export.interval_ms = (seconds > 0 ? seconds : 1) * 1000;
+	    } else if (strncmp(argv[1], "--crossfade=", 12) == 0) {
+	        int ms = atoi(argv[1] + 12);
+	        player_control.crossfade_ms = ms < 0 ? 0 : ms > CROSSFADE_MAX_MS ? CROSSFADE_MAX_MS : ms;
+	    } else {
+	        break;
+	    }
+	    argv[1] = argv[0];
+	}
+	if (render_output) {
+	    snprintf(render_spec, sizeof(render_spec), "file:%s", render_output);
+	    sink_spec = render_spec;
+	}
+	int latency_mode = argc > 1 && argv[1] != NULL && strcmp(argv[1], "--bench-latency") == 0;
+	if (!sink_spec) sink_spec = latency_mode ? "null" : getenv("TAPRAW_SINK");
+	const char *sink_arg = NULL;
+	const SinkOps *sink_ops = sink_spec ? sink_lookup(sink_spec, &sink_arg) : NULL;
+	if (sink_spec && !sink_ops) {
+	    fprintf(stderr, "Unknown output sink: %s (use alsa[:DEVICE], null[:fast], file:PATH[.wav], pipe:COMMAND, stdout)\n", sink_spec);
+	    return 1;
+	}
+	if (sink_ops == &stdout_sink_ops && sink_arg) {
+	    fprintf(stderr, "The stdout sink takes no argument; use pipe:COMMAND to run a command\n");
+	    return 1;
+	}
+	if (sink_ops == &pipe_sink_ops && (!sink_arg || !*sink_arg)) {
+	    fprintf(stderr, "The pipe sink needs a command: pipe:COMMAND\n");
+	    return 1;
+	}
+	if (argc > 1 && argv[1] != NULL && strcmp(argv[1], "--bench-kernels") == 0) {
+	    sample_kernels_init();
+	    return run_kernel_bench();
+	}
+	if (argc > 1 && argv[1] != NULL && (strcmp(argv[1], "--bench") == 0 || strncmp(argv[1], "--bench=", 8) == 0)) {
+	    return run_bench(argv[1][7] == '=' ? argv[1] + 8 : NULL, argc - 2, argv + 2);
+	}
+	if (argc > 1 && argv[1] != NULL && strcmp(argv[1], "--bench-tui") == 0) {
+	    return run_tui_bench(argc - 2, argv + 2);
+	}
+	if (argc > 1 && argv[1] != NULL && strcmp(argv[1], "--check-render") == 0) {
+	    return run_render_check();
+	}
+	if (argc > 1 && argv[1] != NULL && strcmp(argv[1], "--cpu-features") == 0) {
+	    sample_kernels_init();
+	    return run_cpu_features();
+	}
+	int daemon_mode = argc > 1 && argv[1] != NULL &&
+	                  (strcmp(argv[1], "--daemon") == 0 || strncmp(argv[1], "--daemon=", 9) == 0);
+	int headless = daemon_mode || latency_mode || (argc > 1 && argv[1] != NULL &&
+	               (strcmp(argv[1], "--play") == 0 || strcmp(argv[1], "--playlist") == 0));
+	if (sink_ops == &stdout_sink_ops && (!headless || latency_mode)) {
+	    fprintf(stderr, "--sink=stdout needs --play, --playlist or --daemon: the terminal UI draws on stdout\n");
+	    return 2;
+	}
+	if (render_output && (!headless || daemon_mode || latency_mode)) {
+	    fprintf(stderr, "--render=FILE needs --play FILE... or --playlist DIR|LIST.m3u\n");
+	    return 2;
+	}
+	if (headless) {
+	    if (!daemon_mode && !latency_mode && argc < 3) return run_headless(argc - 1, argv + 1);
+	} else if (argc > 1 && argv[1] != NULL) {
 	    if (handle_initial_directory(argc, argv) != 0) {return -1;}
 	} else if (argc > 1) {
 	    display_message(ERROR, "Invalid directory argument");
@@ -2376,11 +7972,21 @@ pthread_cond_init(&player_control.cond, NULL);
 pthread_mutexattr_destroy(&attr);
     pthread_t thread = 0;
     int have_player_thread = 0;
+    sample_kernels_init();
+    fade_tables_init();
+    signal(SIGUSR1, trace_request_dump);
+    status_shm_open();
+    struct timespec render_begin;
+    clock_gettime(CLOCK_MONOTONIC, &render_begin);
+    audio_warmup_start();
     have_player_thread =
     try_start_player_thread(&thread,
                             player_thread,
                             &player_control);
-int result = navigate_and_play();
+    metrics_start();
+int result = !headless ? navigate_and_play() : !have_player_thread ? 1 :
+             daemon_mode ? run_daemon(argv[1]) : latency_mode ? run_latency_bench(argc - 2, argv + 2) :
+             run_headless(argc - 1, argv + 1);
 SAFE_MUTEX_LOCK(&player_control.mutex);
 bool was_playing = (player_control.current_filename != NULL);
 double elapsed = 0.0;
@@ -2394,12 +8000,18 @@ int secs = (int)elapsed % 60;
 if (have_player_thread) {
     shutdown_player_thread(&player_control, thread, &have_player_thread);
 }
+audio_warmup_stop();
+metrics_stop();
+status_shm_close();
+if (render_output) render_report(render_output, &render_begin);
 lock_and_signal(&player_control, cleanup_playlist_and_filename);
+lock_and_signal(&player_control, queue_clear);
 if (have_player_thread) {
     pthread_mutex_destroy(&player_control.mutex);
     pthread_cond_destroy(&player_control.cond);
 }
-handle_program_exit(result, was_playing, hours, mins, secs);
+if (!headless) handle_program_exit(result, was_playing, hours, mins, secs);
+audio_stats_dump(stderr);
 return result;
 }
-// 2405 вариант
+// 8017 вариант